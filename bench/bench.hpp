@@ -0,0 +1,168 @@
+#pragma once
+#include <x86intrin.h>
+#include <chrono>
+#include <ctime>
+#include <cmath>
+#include <cstring>
+#include <cstdlib>
+#include <regex>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+
+// A minimal harness in the manner of Google Benchmark: each benchmark is run for a
+// doubling number of iterations until they take at least --min-time seconds, and the
+// results go to the console and, with --json=<file>, to a JSON file in the format of
+// Google Benchmark (so its compare.py can diff two runs). --filter=<regex> selects
+// benchmarks by name.
+
+namespace bench {
+
+struct Options {
+	double minTime = 0.5;
+	std::regex filter = std::regex(".*");
+	std::string json;
+
+	// Unknown arguments are left to the caller.
+	Options(int argc, char **argv, std::vector<std::string> &rest) {
+		for (int i=1; i<argc; i++) {
+			std::string arg = argv[i];
+			if      (arg.compare(0, 11, "--min-time=") == 0) minTime = atof(arg.c_str()+11);
+			else if (arg.compare(0,  9, "--filter=")   == 0) filter  = std::regex(arg.substr(9));
+			else if (arg.compare(0,  7, "--json=")     == 0) json    = arg.substr(7);
+			else rest.push_back(arg);
+		}
+	}
+
+	bool selected(const std::string &name) const { return std::regex_search(name, filter); }
+};
+
+struct Measurement {
+	size_t iterations = 0;
+	double realTime = 0, cpuTime = 0; // Seconds, for all iterations.
+	uint64_t cycles = 0;              // Time stamp counter ticks, for all iterations.
+};
+
+// Runs f once to warm up, then for as many iterations as take minTime seconds.
+template<typename F>
+Measurement measure(double minTime, F &&f) {
+
+	f();
+	for (size_t n = 1;; ) {
+		Measurement m;
+		m.iterations = n;
+		std::clock_t c0 = std::clock();
+		auto t0 = std::chrono::steady_clock::now();
+		uint64_t tsc0 = __rdtsc();
+		for (size_t i=0; i<n; i++) f();
+		m.cycles = __rdtsc() - tsc0;
+		m.realTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+		m.cpuTime = double(std::clock() - c0) / CLOCKS_PER_SEC;
+
+		if (m.realTime >= minTime or n >= 1000000000) return m;
+		// Aim a bit past minTime, growing at most tenfold at a time as Google Benchmark does.
+		double next = m.realTime > 0 ? 1.4 * n * minTime / m.realTime : 10. * n;
+		n = std::max(n+1, size_t(std::min(next, 10.*n)));
+	}
+}
+
+// Name, value pairs reported along with the timings.
+typedef std::vector<std::pair<std::string, double>> Counters;
+
+class Report {
+
+	std::ofstream json;
+	bool firstJson = true;
+
+	static std::string escape(const std::string &s) {
+		std::string r;
+		for (char c : s) {
+			if (c == '"' or c == '\\') r += '\\';
+			r += c;
+		}
+		return r;
+	}
+
+public:
+	// context holds name, value pairs that describe the run (written to the JSON file only).
+	Report(const Options &options, std::vector<std::pair<std::string, std::string>> context) {
+
+		char date[64];
+		std::time_t now = std::time(nullptr);
+		std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z", std::localtime(&now));
+		context.insert(context.begin(), {
+			{ "date", date },
+			{ "num_cpus", std::to_string(std::thread::hardware_concurrency()) },
+#ifdef __OPTIMIZE__
+			{ "library_build_type", "release" },
+#else
+			{ "library_build_type", "debug" },
+#endif
+		});
+#ifndef __OPTIMIZE__
+		std::cerr << "***WARNING*** Benchmarks built without optimization, timings will be off." << std::endl;
+#endif
+
+		if (not options.json.empty()) {
+			json.open(options.json);
+			if (not json) throw std::runtime_error("Can not write " + options.json);
+			json << "{\n  \"context\": {";
+			for (size_t i=0; i<context.size(); i++)
+				json << (i?",":"") << "\n    \"" << escape(context[i].first) << "\": \"" << escape(context[i].second) << "\"";
+			json << "\n  },\n  \"benchmarks\": [";
+		}
+
+		std::cout << std::left << std::setw(56) << "Benchmark" << std::right
+			<< std::setw(14) << "Time" << std::setw(12) << "Iterations" << "  Counters" << std::endl;
+		std::cout << std::string(100, '-') << std::endl;
+	}
+
+	~Report() {
+		if (json.is_open()) json << "\n  ]\n}\n";
+	}
+
+	// Adds a benchmark that processed bytes bytes on each iteration (0 if it does not
+	// process a byte stream, which leaves out throughput and cycles per byte).
+	void add(const std::string &name, const Measurement &m, size_t bytes, const Counters &counters = Counters()) {
+
+		const double ns = 1e9 * m.realTime / m.iterations;
+		const double cpuNs = 1e9 * m.cpuTime / m.iterations;
+		const double bytesPerSecond = bytes * m.iterations / m.realTime;
+		const double cyclesPerByte = double(m.cycles) / m.iterations / bytes;
+
+		std::ostringstream line;
+		line << std::left << std::setw(56) << name << std::right << std::fixed
+			<< std::setw(11) << std::setprecision(0) << ns << " ns" << std::setw(12) << m.iterations << " ";
+		if (bytes)
+			line << " " << std::setprecision(1) << bytesPerSecond/(1<<20) << "MB/s " << std::setprecision(2) << cyclesPerByte << "c/B";
+		for (auto &&c : counters)
+			line << " " << c.first << "=" << std::setprecision(3) << c.second;
+		std::cout << line.str() << std::endl;
+
+		if (json.is_open()) {
+			json << (firstJson?"":",") << "\n    {"
+				<< "\n      \"name\": \"" << escape(name) << "\","
+				<< "\n      \"run_name\": \"" << escape(name) << "\","
+				<< "\n      \"run_type\": \"iteration\","
+				<< "\n      \"iterations\": " << m.iterations << ","
+				<< std::setprecision(17)
+				<< "\n      \"real_time\": " << ns << ","
+				<< "\n      \"cpu_time\": " << cpuNs << ","
+				<< "\n      \"time_unit\": \"ns\"";
+			if (bytes)
+				json << ",\n      \"bytes_per_second\": " << bytesPerSecond
+					<< ",\n      \"cycles_per_byte\": " << cyclesPerByte;
+			for (auto &&c : counters)
+				json << ",\n      \"" << escape(c.first) << "\": " << c.second;
+			json << "\n    }";
+			json.flush();
+			firstJson = false;
+		}
+	}
+};
+
+}
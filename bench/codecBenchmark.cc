@@ -0,0 +1,106 @@
+#include "marlin.h"
+#include "../src/distribution.hpp"
+#include "../src/dispatch.hpp"
+#include "bench.hpp"
+#include <algorithm>
+#include <memory>
+#include <type_traits>
+
+// Throughput of Marlin (8 bit sources, 8 bit indices) on synthetic sources: compress
+// and decompress of a block, for each distribution family, entropy, dictionary
+// configuration and block size. Blocks are compressed with a reused workspace, as a
+// codec that compresses many blocks would do.
+//
+// compression_ratio is the uncompressed size over the compressed one.
+
+namespace {
+
+struct Config { size_t K, O, maxWordSize; };
+
+const std::pair<Distribution::Type, const char *> types[] = {
+	{ Distribution::Laplace, "Laplace" }, { Distribution::Gaussian, "Gaussian" }, { Distribution::Exponential, "Exponential" } };
+const double hs[] = { 0.1, 0.3, 0.5, 0.7, 0.9 };
+const Config configs[] = { {8,4,7}, {8,4,15}, {8,2,3}, {10,2,7} };
+const size_t blockSizes[] = { 4<<10, 64<<10, 1<<20, 16<<20 };
+
+std::string sizeName(size_t sz) {
+	return sz >= (1<<20) ? std::to_string(sz>>20) + "MB" : std::to_string(sz>>10) + "KB";
+}
+
+}
+
+int main(int argc, char **argv) {
+
+	std::vector<std::string> rest;
+	bench::Options options(argc, argv, rest);
+	if (not rest.empty()) {
+		std::cerr << "Usage: " << argv[0] << " [--filter=<regex>] [--min-time=<seconds>] [--json=<file>]" << std::endl;
+		return -1;
+	}
+
+	bench::Report report(options, {
+		{ "cpu_level", marlin::cpuLevelName(marlin::cpuLevel()) },
+#ifdef MARLIN_GIT_COMMIT
+		{ "commit", MARLIN_GIT_COMMIT },
+#endif
+	});
+
+	for (auto &&type : types) {
+		for (double h : hs) {
+
+			std::ostringstream hName;
+			hName << h;
+			auto pdf = Distribution::pdf(type.first, h);
+			// Generated on first use: prefixes of it are the smaller blocks.
+			std::vector<uint8_t> source;
+
+			for (auto &&config : configs) {
+
+				const std::string prefix = std::string(type.second) + "/h:" + hName.str() + "/K:" + std::to_string(config.K) +
+					"/O:" + std::to_string(config.O) + "/maxWordSize:" + std::to_string(config.maxWordSize) + "/";
+
+				std::unique_ptr<Marlin> codec;
+				for (size_t sz : blockSizes) {
+
+					const std::string compressName = "compress/" + prefix + sizeName(sz);
+					const std::string decompressName = "decompress/" + prefix + sizeName(sz);
+					if (not options.selected(compressName) and not options.selected(decompressName)) continue;
+
+					if (source.empty())
+						source = Distribution::getResiduals(pdf, blockSizes[std::extent<decltype(blockSizes)>::value-1]);
+					if (not codec) {
+						marlin::Configuration conf;
+						conf["K"] = config.K;
+						conf["O"] = config.O;
+						conf["maxWordSize"] = config.maxWordSize;
+						codec.reset(new Marlin("", std::vector<double>(pdf.begin(), pdf.end()), conf));
+					}
+
+					marlin::View<const uint8_t> src(source.data(), source.data()+sz);
+					std::vector<uint8_t> compressed(sz), uncompressed(sz);
+					marlin::MarlinWorkspace workspace;
+
+					ssize_t compressedSize = codec->compress(src, marlin::make_view(compressed), workspace);
+					const marlin::View<const uint8_t> packed(compressed.data(), compressed.data()+std::max(compressedSize, ssize_t(0)));
+					if (compressedSize < 0 or codec->decompress(packed, marlin::make_view(uncompressed)) != ssize_t(sz) or
+						not std::equal(src.start, src.end, uncompressed.begin())) {
+						std::cerr << prefix << sizeName(sz) << " does not roundtrip" << std::endl;
+						return -1;
+					}
+					const bench::Counters counters = { { "compression_ratio", double(sz)/compressedSize } };
+
+					if (options.selected(compressName))
+						report.add(compressName, bench::measure(options.minTime, [&]{
+							codec->compress(src, marlin::make_view(compressed), workspace);
+						}), sz, counters);
+
+					if (options.selected(decompressName))
+						report.add(decompressName, bench::measure(options.minTime, [&]{
+							codec->decompress(packed, marlin::make_view(uncompressed));
+						}), sz, counters);
+				}
+			}
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,137 @@
+#include "marlin.h"
+#include "../src/distribution.hpp"
+#include "../src/buildTiming.hpp"
+#include "bench.hpp"
+#include <atomic>
+#include <malloc.h>
+#include <new>
+
+// Time to build a dictionary and the tables of its codec (a TMarlin from a pdf), for
+// the configurations an application would use, with the time of each phase and the
+// heap used to build it. With no shift or maxWordSize given, the dictionary searches
+// for them as well.
+//
+// <phase>_ms is the time spent in each phase (see buildTiming.hpp), summed over threads.
+// peak_heap_bytes is the most heap in use at once during the build, and
+// retained_heap_bytes what the codec keeps once built (both above what was in use before).
+//
+// --threads=<n> sets the workers of the configuration search (default: all cores).
+
+namespace {
+
+std::atomic<size_t> heapInUse(0), heapPeak(0);
+
+}
+
+// Every allocation of the process goes through these, so the heap used by the
+// library is counted too.
+void *operator new(size_t sz) {
+
+	void *p = malloc(sz ? sz : 1);
+	if (not p) throw std::bad_alloc();
+	size_t now = heapInUse += malloc_usable_size(p);
+	size_t peak = heapPeak;
+	while (now > peak and not heapPeak.compare_exchange_weak(peak, now));
+	return p;
+}
+
+void operator delete(void *p) noexcept {
+
+	if (p) heapInUse -= malloc_usable_size(p);
+	free(p);
+}
+
+void operator delete(void *p, size_t) noexcept { operator delete(p); }
+
+namespace {
+
+const std::pair<Distribution::Type, const char *> types[] = {
+	{ Distribution::Laplace, "Laplace" }, { Distribution::Gaussian, "Gaussian" }, { Distribution::Exponential, "Exponential" } };
+const double hs[] = { 0.1, 0.5, 0.9 };
+
+// Named as in the benchmark names. Entries left out are searched for or take their default.
+const std::vector<std::pair<std::string, marlin::Configuration>> configs8 = {
+	{ "K:8/O:4",                {{"K",8},  {"O",4}} },
+	{ "K:8/O:2/maxWordSize:7",  {{"K",8},  {"O",2}, {"maxWordSize",7}} },
+	{ "K:10/O:2/maxWordSize:7", {{"K",10}, {"O",2}, {"maxWordSize",7}} },
+	{ "K:12/O:0/maxWordSize:15",{{"K",12}, {"O",0}, {"maxWordSize",15}} },
+};
+// Building 16 bit dictionaries is dominated by the alphabet and the shift search.
+const std::vector<std::pair<std::string, marlin::Configuration>> configs16 = {
+	{ "K:8/O:4",                {{"K",8},  {"O",4}} },
+};
+
+template<typename TSource>
+void run(const bench::Options &options, bench::Report &report, const std::vector<std::pair<std::string, marlin::Configuration>> &configs, int threads) {
+
+	for (auto &&type : types) {
+		for (double h : hs) {
+			for (auto &&config : configs) {
+
+				std::ostringstream name;
+				name << "dictionary/" << 8*sizeof(TSource) << "bit/" << type.second << "/h:" << h << "/" << config.first;
+				if (not options.selected(name.str())) continue;
+
+				const std::vector<double> pdf = Distribution::sourcePdf<TSource>(type.first, h);
+				marlin::Configuration conf = config.second;
+				if (threads >= 0) conf["threads"] = threads;
+
+				auto m = bench::measure(options.minTime, [&]{
+					marlin::TMarlin<TSource,uint8_t>("", pdf, conf);
+				});
+
+				// Once more, to break it down.
+				marlin::resetBuildTiming();
+				marlin::enableBuildTiming(true);
+				const size_t before = heapInUse;
+				heapPeak = before;
+				size_t retained;
+				double efficiency;
+				{
+					marlin::TMarlin<TSource,uint8_t> codec("", pdf, conf);
+					retained = heapInUse - before;
+					efficiency = codec.efficiency;
+				}
+				const size_t peak = heapPeak - before;
+				marlin::enableBuildTiming(false);
+
+				bench::Counters counters;
+				for (int phase=0; phase<marlin::BUILD_PHASES; phase++)
+					counters.emplace_back(std::string(marlin::buildPhaseName(marlin::BuildPhase(phase))) + "_ms",
+						1e3 * marlin::buildTime(marlin::BuildPhase(phase)));
+				counters.emplace_back("peak_heap_bytes", peak);
+				counters.emplace_back("retained_heap_bytes", retained);
+				counters.emplace_back("efficiency", efficiency);
+				report.add(name.str(), m, 0, counters);
+			}
+		}
+	}
+}
+
+}
+
+int main(int argc, char **argv) {
+
+	std::vector<std::string> rest;
+	bench::Options options(argc, argv, rest);
+	int threads = -1;
+	for (auto &&arg : rest) {
+		if (arg.compare(0, 10, "--threads=") == 0) {
+			threads = atoi(arg.c_str()+10);
+		} else {
+			std::cerr << "Usage: " << argv[0] << " [--filter=<regex>] [--min-time=<seconds>] [--json=<file>] [--threads=<n>]" << std::endl;
+			return -1;
+		}
+	}
+
+	bench::Report report(options, {
+		{ "threads", threads < 0 ? std::string("all") : std::to_string(threads) },
+#ifdef MARLIN_GIT_COMMIT
+		{ "commit", MARLIN_GIT_COMMIT },
+#endif
+	});
+
+	run<uint8_t>(options, report, configs8, threads);
+	run<uint16_t>(options, report, configs16, threads);
+	return 0;
+}
@@ -138,10 +138,13 @@ public:
 	 ImageMarlinCoder* newCoder();
 
 	 /**
+	  * @param decodeThreads number of threads used to entropy decode the blocks
+	  *   (0 uses all available cores)
+	  *
 	  * @return an ImageMarlinDecoder reference based on the header parameters,
 	  *   which must be destroyed manually
 	  */
- 	 ImageMarlinDecoder* newDecoder();
+ 	 ImageMarlinDecoder* newDecoder(size_t decodeThreads = 0);
 
 	 /**
 	  * Write the header parameters to out in a platform-independent way.
@@ -232,6 +235,16 @@ public:
 	 */
 	void compress(const cv::Mat& img, std::ostream& out);
 
+	/**
+	 * Compress an image with the parameters specified in header
+	 * and store the compressed format bytes in out.
+	 *
+	 * The capacity of out and of the coder's scratch buffers is kept
+	 * between calls, so compressing a sequence of images of the same
+	 * size does not allocate once the first one is done.
+	 */
+	void compress(const cv::Mat& img, std::string& out);
+
 protected:
 	// Header with all configuration parameters
 	const ImageMarlinHeader header;
@@ -239,6 +252,14 @@ protected:
 	ImageMarlinTransformer *const transformer;
 	// Image splitting into blocks and their entropy coding
 	ImageMarlinBlockEC *const blockEC;
+
+	// Scratch buffers reused by compress
+	std::string headerBytes;
+	cv::Mat paddedImage;
+	std::vector<uint8_t> side_information;
+	std::vector<uint8_t> preprocessed;
+	std::vector<uint8_t> entropyCoded;
+	std::string compressed;
 };
 
 class ImageMarlinDecoder {
@@ -320,6 +341,15 @@ public:
 			const std::vector<uint8_t> &uncompressed,
 			size_t blockSize) = 0;
 
+	/// Same as above, but the bitstream is stored in out so that its capacity is reused.
+	/// Subclasses that keep their own scratch buffers should override it.
+	virtual void encodeBlocks(
+			const std::vector<uint8_t> &uncompressed,
+			size_t blockSize,
+			std::vector<uint8_t> &out) {
+		out = encodeBlocks(uncompressed, blockSize);
+	}
+
 	/// Recover a transformed image from a bitstream
 	virtual size_t decodeBlocks(
 			marlin::View<uint8_t> uncompressed,
@@ -327,6 +357,12 @@ public:
 			size_t blockSize);
 
 	virtual ~ImageMarlinBlockEC() {}
+
+	/// Number of threads used by decodeBlocks (0 uses all available cores)
+	size_t decodeThreads = 0;
+
+	/// Number of consecutive blocks (in dictionary order) that a decoding thread takes at once
+	static const size_t DECODE_RUN_LENGTH = 64;
 };
 
 }
@@ -43,6 +43,9 @@ SOFTWARE.
 extern "C" {
 #else
 struct Marlin;
+struct MarlinWorkspace;
+struct MarlinCStream;
+struct MarlinDStream;
 #endif
 
 /*! 
@@ -61,6 +64,31 @@ struct Marlin;
 */
 ssize_t Marlin_compress(const Marlin *dict, uint8_t* dst, size_t dstCapacity, const uint8_t* src, size_t srcSize);
 
+/*! 
+ * Same as Marlin_compress, but scratch memory is taken from workspace ws, so
+ * compressing does not allocate. ws must not be used by two threads at once.
+ * 
+ * \param ws workspace created with Marlin_create_workspace
+ * 
+ * \return same as Marlin_compress
+*/
+ssize_t Marlin_compress_with_workspace(const Marlin *dict, MarlinWorkspace *ws, uint8_t* dst, size_t dstCapacity, const uint8_t* src, size_t srcSize);
+
+/*! 
+ * Creates a workspace for Marlin_compress_with_workspace. It must be freed with Marlin_free_workspace.
+ * 
+ * \return null: error occurred
+ *         otherwise: newly allocated workspace
+*/
+MarlinWorkspace *Marlin_create_workspace();
+
+/*! 
+ * Frees a workspace created with Marlin_create_workspace
+ * 
+ * \param ws workspace to free
+*/
+void Marlin_free_workspace(MarlinWorkspace *ws);
+
 /*! 
  * Uncompresses src to dst using dictionary dict.
  * 
@@ -75,6 +103,178 @@ ssize_t Marlin_compress(const Marlin *dict, uint8_t* dst, size_t dstCapacity, co
 */
 ssize_t Marlin_decompress(const Marlin *dict, uint8_t* dst, size_t dstSize, const uint8_t* src, size_t srcSize);
 
+/*! 
+ * Compresses src to dst using dictionary dict, splitting src in chunks that are
+ * compressed concurrently. The result is a chunked frame that must be
+ * decompressed with Marlin_decompress_parallel.
+ * 
+ * \param dst output buffer
+ * \param dstCapacity allocated capacity of dst (see Marlin_compress_parallel_bound)
+ * \param src input buffer
+ * \param srcSize input buffer size
+ * \param dict dictionary to use for compression
+ * \param chunkSize number of bytes per chunk (0 selects the default)
+ * \param nThreads number of worker threads (0 uses all available cores)
+ * 
+ * \return negative: error occurred
+ *         positive: size of the compressed frame
+*/
+ssize_t Marlin_compress_parallel(const Marlin *dict, uint8_t* dst, size_t dstCapacity, const uint8_t* src, size_t srcSize, size_t chunkSize, size_t nThreads);
+
+/*! 
+ * Uncompresses a chunked frame produced by Marlin_compress_parallel.
+ * 
+ * \param dst output buffer
+ * \param dstSize ouput buffer size
+ * \param src input buffer
+ * \param srcSize input buffer size
+ * \param dict dictionary to use for decompression
+ * \param nThreads number of worker threads (0 uses all available cores)
+ * 
+ * \return negative: error occurred
+ *         positive: number of uncompressed bytes (must match dstSize)
+*/
+ssize_t Marlin_decompress_parallel(const Marlin *dict, uint8_t* dst, size_t dstSize, const uint8_t* src, size_t srcSize, size_t nThreads);
+
+/*! 
+ * Returns the capacity dst must have for Marlin_compress_parallel to succeed.
+ * 
+ * \param srcSize input buffer size
+ * \param chunkSize number of bytes per chunk (0 selects the default)
+*/
+size_t Marlin_compress_parallel_bound(size_t srcSize, size_t chunkSize);
+
+/*! 
+ * Compresses src to a self-describing frame: it records the dictionary, the uncompressed
+ * size and the size of every block, and optionally a checksum of the content.
+ * 
+ * \param dst output buffer
+ * \param dstCapacity allocated capacity of dst (see Marlin_compress_frame_bound)
+ * \param src input buffer
+ * \param srcSize input buffer size
+ * \param dict dictionary to use for compression
+ * \param checksum if not zero, an XXH64 checksum of src is appended to the frame
+ * 
+ * \return negative: error occurred
+ *         positive: size of the frame
+*/
+ssize_t Marlin_compress_frame(const Marlin *dict, uint8_t* dst, size_t dstCapacity, const uint8_t* src, size_t srcSize, int checksum);
+
+/*! 
+ * Uncompresses a frame produced by Marlin_compress_frame with the same dictionary.
+ * 
+ * \param dst output buffer
+ * \param dstSize ouput buffer size, must be exactly Marlin_frame_content_size
+ * \param src input buffer
+ * \param srcSize input buffer size
+ * \param dict dictionary to use for decompression
+ * 
+ * \return negative: error occurred (including a checksum mismatch or a different dictionary)
+ *         otherwise: number of uncompressed bytes
+*/
+ssize_t Marlin_decompress_frame(const Marlin *dict, uint8_t* dst, size_t dstSize, const uint8_t* src, size_t srcSize);
+
+/*! 
+ * Returns the capacity dst must have for Marlin_compress_frame to succeed.
+ * 
+ * \param srcSize input buffer size
+*/
+size_t Marlin_compress_frame_bound(size_t srcSize);
+
+/*! 
+ * Reads the uncompressed size stored in a frame, so the output can be allocated exactly.
+ * 
+ * \param src input buffer
+ * \param srcSize input buffer size
+ * 
+ * \return negative: src does not start with a valid frame
+ *         otherwise: number of uncompressed bytes
+*/
+ssize_t Marlin_frame_content_size(const uint8_t* src, size_t srcSize);
+
+/*! 
+ * Creates a stream that writes a frame from input given in pieces of any size. Its memory
+ * does not grow with the input. Stream must be freed with Marlin_free_cstream.
+ * 
+ * \param dict dictionary to use for compression, must outlive the stream
+ * \param checksum if not zero, an XXH64 checksum of the input is appended to the frame
+ * 
+ * \return null: error occurred
+ *         otherwise: newly allocated stream
+*/
+MarlinCStream *Marlin_create_cstream(const Marlin *dict, int checksum);
+
+/*! 
+ * Frees a stream created with Marlin_create_cstream
+ * 
+ * \param cs stream to free
+*/
+void Marlin_free_cstream(MarlinCStream *cs);
+
+/*! 
+ * Consumes input and writes frame bytes. Either all input is consumed or dst is full.
+ * 
+ * \param dst output buffer
+ * \param dstCapacity allocated capacity of dst
+ * \param dstPos position in dst where writing starts, updated past the bytes written
+ * \param src input buffer
+ * \param srcSize input buffer size
+ * \param srcPos position in src where reading starts, updated past the bytes consumed
+ * 
+ * \return negative: error occurred
+ *         0: success
+*/
+ssize_t Marlin_compress_stream(MarlinCStream *cs, uint8_t* dst, size_t dstCapacity, size_t *dstPos, const uint8_t* src, size_t srcSize, size_t *srcPos);
+
+/*! 
+ * Closes the frame. Must be called again while it returns a positive value; once it
+ * returns 0, the next call to Marlin_compress_stream starts a new frame.
+ * 
+ * \param dst output buffer
+ * \param dstCapacity allocated capacity of dst
+ * \param dstPos position in dst where writing starts, updated past the bytes written
+ * 
+ * \return negative: error occurred
+ *         0: the frame is complete
+ *         positive: number of bytes left to write
+*/
+ssize_t Marlin_end_stream(MarlinCStream *cs, uint8_t* dst, size_t dstCapacity, size_t *dstPos);
+
+/*! 
+ * Creates a stream that decodes frames written by Marlin_compress_stream from input given
+ * in pieces of any size. Stream must be freed with Marlin_free_dstream.
+ * 
+ * \param dict dictionary to use for decompression, must outlive the stream
+ * 
+ * \return null: error occurred
+ *         otherwise: newly allocated stream
+*/
+MarlinDStream *Marlin_create_dstream(const Marlin *dict);
+
+/*! 
+ * Frees a stream created with Marlin_create_dstream
+ * 
+ * \param ds stream to free
+*/
+void Marlin_free_dstream(MarlinDStream *ds);
+
+/*! 
+ * Consumes frame bytes and writes uncompressed bytes. Frames may follow each other in src:
+ * decoding stops at the end of each one, and the next call continues with the following frame.
+ * 
+ * \param dst output buffer
+ * \param dstCapacity allocated capacity of dst
+ * \param dstPos position in dst where writing starts, updated past the bytes written
+ * \param src input buffer
+ * \param srcSize input buffer size
+ * \param srcPos position in src where reading starts, updated past the bytes consumed
+ * 
+ * \return negative: error occurred (including a checksum mismatch or a different dictionary)
+ *         0: a frame has been completely decoded and written
+ *         positive: more input or output space is needed
+*/
+ssize_t Marlin_decompress_stream(MarlinDStream *ds, uint8_t* dst, size_t dstCapacity, size_t *dstPos, const uint8_t* src, size_t srcSize, size_t *srcPos);
+
 /*! 
  * Builds an optimal for a 8 bit memoryless source. Dictionary must be freed with Marlin_free_dictionary.
  * 
@@ -97,6 +297,29 @@ Marlin *Marlin_build_dictionary(const char *name, const double hist[256]);
 */
 void Marlin_free_dictionary(Marlin *dict);
 
+/*! 
+ * Writes a dictionary to a file, in the binary format read by Marlin_load_dictionary.
+ * 
+ * \param dict dictionary to write
+ * \param path name of the file
+ * 
+ * \return negative: error occurred
+ *         0: success
+*/
+int Marlin_save_dictionary(const Marlin *dict, const char *path);
+
+/*! 
+ * Maps a dictionary file written by Marlin_save_dictionary. The tables are used in place,
+ * so processes that load the same file share its memory. Dictionary must be freed with 
+ * Marlin_free_dictionary.
+ * 
+ * \param path name of the file
+ * 
+ * \return null: error occurred
+ *         otherwise: newly allocated dictionary
+*/
+Marlin *Marlin_load_dictionary(const char *path);
+
 /*! 
  * Obtains a set of pre-built dictionaries (THose must not be freed).
  * 
@@ -105,10 +328,15 @@ void Marlin_free_dictionary(Marlin *dict);
 const Marlin **Marlin_get_prebuilt_dictionaries();
 
 /*! 
- * Estimates how much space a dictionary will take to compress a source with a histogram hist.
+ * Chooses the dictionary expected to compress src best. The choice is made from the
+ * histogram of src and a cost model of each dictionary, without compressing anything.
  * 
- * \return negative: error occurred
- *         positive: expected space used to compress hist using dictionary dict
+ * \param dict vector of dictionary pointers ended in nullptr
+ * \param src input buffer
+ * \param srcSize input buffer size
+ * 
+ * \return null: no dictionary was given
+ *         otherwise: the dictionary with the smallest estimated compressed size
 */
 const Marlin * Marlin_estimate_best_dictionary(const Marlin **dict, const uint8_t* src, size_t srcSize);
 
@@ -37,6 +37,12 @@ SOFTWARE.
 #include <vector>
 #include <map>
 #include <memory>
+#include <array>
+#include <string>
+#include <algorithm>
+#include <type_traits>
+#include <atomic>
+#include <thread>
 
 // TSource is a type that represents the data type of the source 
 //  (i.e., uint8_t and uint16_t are supported now)
@@ -49,6 +55,7 @@ namespace marlin {
 template<typename T>
 struct View {
 	T *start, *end;
+	View() : start(nullptr), end(nullptr) {}
 	View(T *start_, T *end_) : start(start_), end(end_) {}
 	size_t nElements() const { return end - start; }
 	size_t nBytes() const { return sizeof(T)*(end - start); }
@@ -59,6 +66,61 @@ template<typename T> static View<T> make_view(T *start, T *end)  { return View<T
 template<typename T> static View<T> make_view(std::vector<T> &v) { return View<T>(&v[0], &v[v.size()]); }
 template<typename T> static View<const T> make_view(const std::vector<T> &v) { return View<const T>(&v[0], &v[v.size()]); }
 
+// Fixed size array that keeps its elements on the heap.
+template<typename T, size_t N>
+struct HeapArray : std::vector<T> {
+	HeapArray() : std::vector<T>(N) {}
+	void fill(const T &v) { std::fill(this->begin(), this->end(), v); }
+};
+
+// One value for each source symbol. The 65536 entries of 16 bit sources would take
+// 512KB of the stack, or of the object holding them, so they go to the heap.
+template<typename TSource, typename T>
+using SymbolArray = typename std::conditional<sizeof(TSource)==1,
+	std::array<T, 1U<<(sizeof(TSource)*8)>, HeapArray<T, 1U<<(sizeof(TSource)*8)>>::type;
+
+// Number of occurrences of each symbol in src.
+template<typename TSource>
+SymbolArray<TSource,size_t> histogram(View<const TSource> src);
+
+// What a single read of a block tells about it: the histogram of its symbols, and how
+// many symbols repeat the one before them (the block is one run when all but the first
+// do). compress skips its own scan for single symbol blocks when given these, and
+// dictionary selection and the adaptive compressor only need the histogram.
+template<typename TSource>
+struct BlockStats {
+	SymbolArray<TSource,size_t> histogram;
+	size_t nElements;
+	size_t nRepeated;
+	
+	bool isSingleSymbol() const { return nElements and nRepeated+1 == nElements; }
+	// Average length of the runs of equal symbols.
+	double meanRunLength() const { return nElements ? double(nElements)/(nElements-nRepeated) : 0.; }
+};
+
+template<typename TSource>
+void blockStats(View<const TSource> src, BlockStats<TSource> &stats);
+template<typename TSource>
+BlockStats<TSource> blockStats(View<const TSource> src) {
+	BlockStats<TSource> ret;
+	blockStats(src, ret);
+	return ret;
+}
+
+// Scratch memory used by compress. Reusing the same workspace across calls keeps
+// compression off the heap. A workspace must not be shared between threads.
+struct MarlinWorkspace {
+	// Positions of the symbols the dictionary can not represent. It grows to the most
+	// a block has needed, and is reused from then on.
+	std::vector<size_t> unrepresentedSymbols;
+	// Start and length of the long runs of the most common symbol cut out of a block,
+	// and the symbols left once they are.
+	std::vector<size_t> runs;
+	std::vector<uint8_t> packed;
+	
+	MarlinWorkspace() { unrepresentedSymbols.reserve(256); }
+};
+
 
 template<typename TSource>
 struct MarlinSymbol_ {
@@ -143,6 +205,8 @@ struct TMarlinCompress {
 	typedef uint32_t CompressorTableIdx;      
 	const MarlinIdx unrepresentedSymbolToken;
 	const std::array<MarlinIdx, 1U<<(sizeof(TSource)*8)> source2marlin;
+	// Source symbol of Marlin symbol 0, the one runs are made of (see compressBlock).
+	const TSource runSymbol = buildRunSymbol();
 	const std::shared_ptr<std::vector<CompressorTableIdx>> compressorTableVector;	
 	const CompressorTableIdx* const compressorTablePointer;	
 	const std::shared_ptr<std::vector<CompressorTableIdx>> compressorTableInitVector;
@@ -155,6 +219,22 @@ struct TMarlinCompress {
 		dst.resize(r);
 		return dst.size();
 	}
+	// Same as compress, but all scratch memory comes from workspace.
+	ssize_t compress(View<const TSource> src, View<uint8_t> dst, MarlinWorkspace &workspace) const;
+	// Same, for a block whose statistics were already gathered with blockStats(src).
+	ssize_t compress(View<const TSource> src, View<uint8_t> dst, MarlinWorkspace &workspace, const BlockStats<TSource> &stats) const;
+
+	// Chunked frame: src is split in chunks of chunkSize symbols which are compressed
+	// independently by nThreads workers (0 means all cores) and stored after a chunk index.
+	// dst must hold at least parallelBound(src.nElements(), chunkSize) bytes.
+	ssize_t compressParallel(View<const TSource> src, View<uint8_t> dst, size_t chunkSize = 0, size_t nThreads = 0) const;
+	ssize_t compressParallel(const std::vector<TSource> &src, std::vector<uint8_t> &dst, size_t chunkSize = 0, size_t nThreads = 0) const {
+		ssize_t r = compressParallel(make_view(src), make_view(dst), chunkSize, nThreads);
+		if (r<0) return r;
+		dst.resize(r);
+		return dst.size();
+	}
+	static size_t parallelBound(size_t nElements, size_t chunkSize = 0);
 	
 	TMarlinCompress(const TMarlinDictionary<TSource,MarlinIdx> &dictionary) :
 		K(dictionary.K), O(dictionary.O), shift(dictionary.shift), maxWordSize(dictionary.maxWordSize), 
@@ -184,9 +264,12 @@ struct TMarlinCompress {
 	{}
 
 	constexpr static const size_t FLAG_NEXT_WORD = 1UL<<(8*sizeof(CompressorTableIdx)-1);
+	constexpr static const size_t DEFAULT_CHUNK_SIZE = 1UL<<18;
 
 private:
+	ssize_t compressBlock(View<const TSource> src, View<uint8_t> dst, MarlinWorkspace &workspace, const BlockStats<TSource> *stats = nullptr) const;
 	std::array<MarlinIdx, 1U<<(sizeof(TSource)*8)> buildSource2marlin(const TMarlinDictionary<TSource,MarlinIdx> &dictionary) const;
+	TSource buildRunSymbol() const;
 	std::unique_ptr<std::vector<CompressorTableIdx>> buildCompressorTable(const TMarlinDictionary<TSource,MarlinIdx> &dictionary) const;
 	std::unique_ptr<std::vector<CompressorTableIdx>> buildCompressorTableInit(const TMarlinDictionary<TSource,MarlinIdx> &dictionary) const;
 };
@@ -203,17 +286,29 @@ struct TMarlinDecompress {
 	const TSource marlinMostCommonSymbol;
 	const bool isSkip;
 	
+	// Decodes the Marlin stream of a block. Chosen once for K, O, maxWordSize and isSkip,
+	// so that most dictionaries get a kernel where all of them are compile time constants.
+	typedef void (*DecodeFunction)(const TMarlinDecompress &, View<const uint8_t>, View<TSource>);
+	const DecodeFunction decodeFunction;
+	
 	ssize_t decompress(View<const uint8_t> src, View<TSource> dst) const;
 	ssize_t decompress(const std::vector<uint8_t> &src, std::vector<TSource> &dst) const {
 		return decompress(make_view(src), make_view(dst));
 	}
 
+	// Decodes a chunked frame produced by compressParallel using nThreads workers (0 means all cores).
+	ssize_t decompressParallel(View<const uint8_t> src, View<TSource> dst, size_t nThreads = 0) const;
+	ssize_t decompressParallel(const std::vector<uint8_t> &src, std::vector<TSource> &dst, size_t nThreads = 0) const {
+		return decompressParallel(make_view(src), make_view(dst), nThreads);
+	}
+
 	TMarlinDecompress(const TMarlinDictionary<TSource,MarlinIdx> &dictionary) :
 		K(dictionary.K), O(dictionary.O), shift(dictionary.shift), maxWordSize(dictionary.maxWordSize),
 		decompressorTableVector(buildDecompressorTable(dictionary)),
 		decompressorTablePointer(decompressorTableVector->data()),
 		marlinMostCommonSymbol(dictionary.marlinAlphabet.front().sourceSymbol),
-		isSkip(dictionary.isSkip)
+		isSkip(dictionary.isSkip),
+		decodeFunction(selectDecodeFunction(K, O, maxWordSize, isSkip))
 	{}
 	
 	TMarlinDecompress(
@@ -226,9 +321,11 @@ struct TMarlinDecompress {
 		decompressorTableVector(),
 		decompressorTablePointer(decompressorTablePointer_),
 		marlinMostCommonSymbol(marlinMostCommonSymbol_),
-		isSkip(isSkip_)
+		isSkip(isSkip_),
+		decodeFunction(selectDecodeFunction(K, O, maxWordSize, isSkip))
 	{}	
 private:
+	static DecodeFunction selectDecodeFunction(size_t K, size_t O, size_t maxWordSize, bool isSkip);
 	std::unique_ptr<std::vector<TSource>> buildDecompressorTable(const TMarlinDictionary<TSource,MarlinIdx> &dictionary) const;
 };
 
@@ -239,6 +336,60 @@ struct TMarlin :
 		
 	const std::string name;
 	const size_t K,O,shift,maxWordSize;
+	
+	typedef SymbolArray<TSource,double> SymbolCost;
+	typedef SymbolArray<TSource,size_t> Histogram;
+	
+	// Expected bits spent on each source symbol, derived from the dictionary words.
+	const SymbolCost symbolCost = buildSymbolCost();
+	
+	// Expected compressed size in bytes of a block whose histogram is hist.
+	double estimateSize(const Histogram &hist) const;
+	// Same, also knowing whether the block is a single symbol, which compress stores as is.
+	double estimateSize(const BlockStats<TSource> &stats) const;
+	
+	// Hash of the tables, which frames store to tell which dictionary decodes them.
+	const uint32_t id = buildId();
+	
+	// Self-describing frame: a header with the dictionary id, the number of symbols and
+	// the block size, the compressed size of each block of blockSize symbols (0 selects
+	// the default), the blocks, and an XXH64 checksum of the content if requested.
+	// dst must hold at least frameBound(src.nElements(), blockSize) bytes.
+	ssize_t compressFrame(View<const TSource> src, View<uint8_t> dst, bool checksum = true, size_t blockSize = 0) const;
+	ssize_t compressFrame(const std::vector<TSource> &src, std::vector<uint8_t> &dst, bool checksum = true, size_t blockSize = 0) const {
+		ssize_t r = compressFrame(make_view(src), make_view(dst), checksum, blockSize);
+		if (r<0) return r;
+		dst.resize(r);
+		return dst.size();
+	}
+	static size_t frameBound(size_t nElements, size_t blockSize = 0);
+	
+	// Decodes a frame written with this dictionary. dst must hold exactly the number
+	// of symbols in the frame (see frameContentSize). Streamed frames, written by
+	// TMarlinCStream, are decoded with TMarlinDStream instead.
+	ssize_t decompressFrame(View<const uint8_t> src, View<TSource> dst) const;
+	ssize_t decompressFrame(const std::vector<uint8_t> &src, std::vector<TSource> &dst) const {
+		return decompressFrame(make_view(src), make_view(dst));
+	}
+	
+	// Number of symbols in the frame at src, and id of the dictionary that decodes it.
+	// Both return -1 if src does not start with a valid frame header, and the number
+	// of symbols is -1 as well for streamed frames, which do not store it.
+	static ssize_t frameContentSize(View<const uint8_t> src);
+	static int64_t frameDictionaryId(View<const uint8_t> src);
+	
+	// Keeps alive the memory of the tables when they are not owned by the
+	// compressor and decompressor (e.g., a mapped dictionary file).
+	const std::shared_ptr<const void> storage;
+	
+	// Writes the dictionary to path in the binary format read by load.
+	// Returns false if the file could not be written.
+	bool save(const std::string &path) const;
+	
+	// Maps a dictionary file written by save. The tables are used in place, so all
+	// processes that load the same file share one copy. Returns nullptr if the file
+	// can not be mapped or is not a valid dictionary for TSource and MarlinIdx.
+	static std::unique_ptr<TMarlin> load(const std::string &path);
 
 	
 	TMarlin( 
@@ -267,7 +418,8 @@ struct TMarlin :
 		const typename TMarlinCompress<TSource,MarlinIdx>::CompressorTableIdx* compressorTableInitPointer_,
 		const TSource* decompressorTablePointer_,
 		const TSource marlinMostCommonSymbol_,
-		const bool isSkip_
+		const bool isSkip_,
+		std::shared_ptr<const void> storage_ = nullptr
 		) :
 		TMarlinCompress<TSource,MarlinIdx>(
 			K_, O_, shift_, maxWordSize_, efficiency_,
@@ -275,7 +427,199 @@ struct TMarlin :
 		TMarlinDecompress<TSource,MarlinIdx>(
 			K_, O_, shift_, maxWordSize_, decompressorTablePointer_, marlinMostCommonSymbol_, isSkip_),
 		name(name_),
-		K(K_), O(O_), shift(shift_), maxWordSize(maxWordSize_) {}
+		K(K_), O(O_), shift(shift_), maxWordSize(maxWordSize_),
+		storage(storage_) {}
+
+private:
+	SymbolCost buildSymbolCost() const;
+	uint32_t buildId() const;
+};
+
+class XXHash64;
+
+// Writes a streamed frame from input that arrives in pieces of any size, keeping at
+// most one block of symbols and one compressed block in memory. Whole blocks go
+// straight from src to dst when nothing is buffered.
+template<typename TSource, typename MarlinIdx>
+struct TMarlinCStream {
+	
+	typedef TMarlin<TSource,MarlinIdx> Dictionary;
+	
+	// dictionary must outlive the stream. blockSize 0 selects the default.
+	TMarlinCStream(const Dictionary &dictionary_, bool checksum_ = true, size_t blockSize_ = 0);
+	~TMarlinCStream();
+	
+	// Consumes symbols from src and writes frame bytes to dst, advancing the start of
+	// both past what was used. Returns 0 or a negative value on error.
+	ssize_t compress(View<const TSource> &src, View<uint8_t> &dst);
+	
+	// Compresses the buffered symbols and closes the frame. Returns the number of bytes
+	// that did not fit in dst yet: call it again until it returns 0. After that, the
+	// next call to compress starts a new frame.
+	ssize_t end(View<uint8_t> &dst);
+	
+	const Dictionary &dictionary;
+	const bool checksum;
+	const size_t blockSize;
+	
+	// Largest block a stream accepts, which bounds the memory of the decoder.
+	constexpr static const size_t MAX_BLOCK_SIZE = 1U<<22;
+	
+private:
+	std::vector<TSource> input;          // Symbols of the next block
+	std::vector<uint8_t> pending;        // Frame bytes that did not fit in dst yet
+	size_t pendingPos = 0;
+	bool started = false, ended = false;
+	std::unique_ptr<XXHash64> hash;
+	MarlinWorkspace workspace;
+	
+	void start();
+	ssize_t encodeBlock(View<const TSource> block, View<uint8_t> &dst);
+	size_t flush(View<uint8_t> &dst);
+};
+
+// Decodes streamed frames from input that arrives in pieces of any size, keeping at
+// most one compressed block and one block of symbols in memory.
+template<typename TSource, typename MarlinIdx>
+struct TMarlinDStream {
+	
+	typedef TMarlin<TSource,MarlinIdx> Dictionary;
+	
+	// dictionary must outlive the stream.
+	TMarlinDStream(const Dictionary &dictionary_);
+	~TMarlinDStream();
+	
+	// Consumes frame bytes from src and writes symbols to dst, advancing the start of
+	// both past what was used. Returns 0 once a whole frame has been decoded and
+	// written, a positive value while it is not, and a negative value on error (for
+	// instance a corrupted frame, or one written with another dictionary). Frames may
+	// follow each other in the input: decoding stops at the end of each one, and the
+	// next call continues with the following frame.
+	ssize_t decompress(View<const uint8_t> &src, View<TSource> &dst);
+	
+	const Dictionary &dictionary;
+	
+private:
+	enum class Stage { Header, Entry, Block, Checksum, Done, Error };
+	Stage stage = Stage::Header;
+	
+	std::vector<uint8_t> input;          // Bytes of the current stage gathered so far
+	size_t needed;                       // Bytes that complete the current stage
+	std::vector<TSource> output;         // Decoded symbols that did not fit in dst yet
+	size_t outputPos = 0;
+	
+	bool checksum = false;
+	size_t blockSize = 0, blockElements = 0;
+	std::unique_ptr<XXHash64> hash;
+	
+	const uint8_t *take(View<const uint8_t> &src);
+	bool step(const uint8_t *data, View<TSource> &dst);
+};
+
+// Compresses a sequence of blocks with a dictionary that follows the data.
+//
+// A running histogram of the recent symbols is kept. When blocks compress noticeably
+// worse than the efficiency expected from a dictionary built for that histogram, the
+// histogram restarts, and once it holds historySize/2 new symbols a dictionary is built
+// from it in a background thread. It replaces the current one at the first block after
+// it is ready, so compress never waits for it.
+//
+// Every block is stored as a record tagged with the id of its dictionary, and the first
+// record of each new dictionary carries the histogram it was built from, so that
+// TMarlinAdaptiveDecompress can build the very same dictionary. Dictionary 0 is the
+// initial one: both sides must be given the same initial dictionary and conf.
+template<typename TSource, typename MarlinIdx>
+struct TMarlinAdaptiveCompress {
+	
+	typedef TMarlin<TSource,MarlinIdx> Dictionary;
+	typedef SymbolArray<TSource,size_t> Histogram;
+	
+	// conf is used to build the new dictionaries. A rebuild starts when the observed
+	// efficiency falls retrainThreshold (relative) below the expected one. The running
+	// histogram is made of the last historySize symbols, give or take a factor of two.
+	TMarlinAdaptiveCompress(
+		std::shared_ptr<const Dictionary> initial,
+		Configuration conf_ = Configuration(),
+		double retrainThreshold_ = 0.05,
+		size_t historySize_ = 1U<<20);
+	~TMarlinAdaptiveCompress();
+	
+	// Writes the record of src to dst, which must hold at least bound(src.nElements()) bytes.
+	ssize_t compress(View<const TSource> src, View<uint8_t> dst);
+	ssize_t compress(const std::vector<TSource> &src, std::vector<uint8_t> &dst) {
+		ssize_t r = compress(make_view(src), make_view(dst));
+		if (r<0) return r;
+		dst.resize(r);
+		return dst.size();
+	}
+	static size_t bound(size_t nElements);
+	
+	// Dictionary that will compress the next block, and its id.
+	const std::shared_ptr<const Dictionary> &dictionary() const { return current; }
+	uint32_t dictionaryId() const { return currentId; }
+	
+	// Waits for the dictionary being built, if any. It is used from the next block on.
+	void wait();
+	
+	// Record layout (all fields little endian uint32_t): dictionaryId, flags, nElements, payloadSize,
+	// then the histogram of the dictionary if FLAG_HISTOGRAM, then a regular Marlin block.
+	constexpr static const size_t RECORD_HEADER_SIZE = 4*sizeof(uint32_t);
+	constexpr static const uint32_t FLAG_HISTOGRAM = 1;
+	
+private:
+	const Configuration conf;
+	const double retrainThreshold;
+	const size_t historySize;
+	
+	std::shared_ptr<const Dictionary> current;
+	uint32_t currentId = 0;
+	std::vector<uint32_t> currentCounts; // Histogram of current, until it has been written
+	
+	BlockStats<TSource> lastStats;       // Of the last block, reused to stay off the heap
+	Histogram history;                   // Running histogram, halved as it grows
+	size_t historyTotal = 0;
+	double historyInformation = 0;       // Sum of h*log2(h) over the bins of history
+	double observedBits = 0, expectedBits = 0;
+	size_t symbolsSinceSwap = 0;
+	bool collecting = false;             // Filling history to build a new dictionary
+	
+	std::thread builder;
+	std::atomic<bool> nextReady;
+	std::shared_ptr<const Dictionary> next;
+	std::vector<uint32_t> nextCounts;
+	
+	MarlinWorkspace workspace;
+	
+	void update(const BlockStats<TSource> &stats, size_t payloadSize);
+	void swapIfReady();
+};
+
+// Decodes the records written by TMarlinAdaptiveCompress, building each new dictionary
+// from the histogram stored in its first record.
+template<typename TSource, typename MarlinIdx>
+struct TMarlinAdaptiveDecompress {
+	
+	typedef TMarlin<TSource,MarlinIdx> Dictionary;
+	
+	TMarlinAdaptiveDecompress(
+		std::shared_ptr<const Dictionary> initial,
+		Configuration conf_ = Configuration());
+	
+	// Decodes the records of src, one after the other, into dst.
+	// Returns the number of decoded symbols or a negative value on error.
+	ssize_t decompress(View<const uint8_t> src, View<TSource> dst);
+	ssize_t decompress(const std::vector<uint8_t> &src, std::vector<TSource> &dst) {
+		return decompress(make_view(src), make_view(dst));
+	}
+	
+	// Dictionary of the last decoded record, and its id.
+	const std::shared_ptr<const Dictionary> &dictionary() const { return current; }
+	uint32_t dictionaryId() const { return currentId; }
+	
+private:
+	const Configuration conf;
+	std::shared_ptr<const Dictionary> current;
+	uint32_t currentId = 0;
 };
 
 
@@ -284,6 +628,16 @@ struct TMarlin :
 
 
 typedef marlin::TMarlin<uint8_t,uint8_t> Marlin;
+typedef marlin::MarlinWorkspace MarlinWorkspace;
+typedef marlin::TMarlinCStream<uint8_t,uint8_t> MarlinCStream;
+typedef marlin::TMarlinDStream<uint8_t,uint8_t> MarlinDStream;
+typedef marlin::TMarlinAdaptiveCompress<uint8_t,uint8_t> MarlinAdaptiveCompress;
+typedef marlin::TMarlinAdaptiveDecompress<uint8_t,uint8_t> MarlinAdaptiveDecompress;
+
+// 16 bit sources, such as the samples of high bit depth images.
+typedef marlin::TMarlin<uint16_t,uint8_t> Marlin16;
+typedef marlin::TMarlinCStream<uint16_t,uint8_t> Marlin16CStream;
+typedef marlin::TMarlinDStream<uint16_t,uint8_t> Marlin16DStream;
 
 #endif
 #endif
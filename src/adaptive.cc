@@ -0,0 +1,267 @@
+/***********************************************************************
+
+adaptive: streaming compression with dictionaries retrained in the background
+
+MIT License
+
+Copyright (c) 2017 Manuel Martinez Torres
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+***********************************************************************/
+
+#include <marlin.h>
+
+#include <cstring>
+#include <cmath>
+
+#include "frame.hpp"
+
+using namespace marlin;
+
+namespace {
+
+// Both sides build the dictionary of a record from the same counts, so they get the same tables.
+template<typename TSource, typename MarlinIdx>
+std::shared_ptr<const TMarlin<TSource,MarlinIdx>> buildAdaptiveDictionary(uint32_t id, const std::vector<uint32_t> &counts, const Configuration &conf) {
+	
+	double total = 0;
+	for (auto &&c : counts) total += c;
+	
+	std::vector<double> pdf;
+	for (auto &&c : counts) pdf.push_back(total ? c/total : 0.);
+	
+	return std::make_shared<const TMarlin<TSource,MarlinIdx>>("adaptive" + std::to_string(id), pdf, conf);
+}
+
+template<typename TSource>
+constexpr size_t histogramEntries() { return size_t(1)<<(8*sizeof(TSource)); }
+
+// Term of a histogram bin in sum(h*log2(h)), from which the entropy of the histogram is
+// log2(total) - sum/total.
+inline double binInformation(size_t h) { return h ? h*std::log2(double(h)) : 0.; }
+
+}
+
+////////////////////////////////////////////////////////////////////////
+//
+// Compression
+
+template<typename TSource, typename MarlinIdx>
+TMarlinAdaptiveCompress<TSource,MarlinIdx>::TMarlinAdaptiveCompress(
+	std::shared_ptr<const Dictionary> initial,
+	Configuration conf_,
+	double retrainThreshold_,
+	size_t historySize_) :
+	conf(conf_),
+	retrainThreshold(retrainThreshold_),
+	historySize(std::max(size_t(1), std::min(historySize_, size_t(1)<<30))), // Counts must fit in 32 bits
+	current(initial),
+	nextReady(false) {
+	
+	history.fill(0);
+}
+
+template<typename TSource, typename MarlinIdx>
+TMarlinAdaptiveCompress<TSource,MarlinIdx>::~TMarlinAdaptiveCompress() {
+	
+	if (builder.joinable())
+		builder.join();
+}
+
+template<typename TSource, typename MarlinIdx>
+size_t TMarlinAdaptiveCompress<TSource,MarlinIdx>::bound(size_t nElements) {
+	
+	return RECORD_HEADER_SIZE + histogramEntries<TSource>()*sizeof(uint32_t) + nElements*sizeof(TSource);
+}
+
+template<typename TSource, typename MarlinIdx>
+ssize_t TMarlinAdaptiveCompress<TSource,MarlinIdx>::compress(View<const TSource> src, View<uint8_t> dst) {
+	
+	if (src.nElements() > 0xFFFFFFFFULL) return -1;
+	if (dst.nBytes() < bound(src.nElements())) return -1;
+	
+	swapIfReady();
+	
+	uint32_t header[4] = { currentId, 0, uint32_t(src.nElements()), 0 };
+	uint8_t *out = dst.start + RECORD_HEADER_SIZE;
+	if (not currentCounts.empty()) {
+		header[1] |= FLAG_HISTOGRAM;
+		for (auto &&c : currentCounts) {
+			storeLE32(out, c);
+			out += sizeof(uint32_t);
+		}
+	}
+	
+	// One read of src gives both the histogram kept for the next dictionary and what
+	// compress would otherwise scan for.
+	blockStats(src, lastStats);
+	ssize_t payloadSize = current->compress(src, marlin::make_view(out, dst.end), workspace, lastStats);
+	if (payloadSize < 0 or payloadSize > 0xFFFFFFFFLL) return -1;
+	header[3] = payloadSize;
+	for (size_t i=0; i<4; i++)
+		storeLE32(dst.start + i*sizeof(uint32_t), header[i]);
+	currentCounts.clear();
+	
+	update(lastStats, payloadSize);
+	
+	return out + payloadSize - dst.start;
+}
+
+template<typename TSource, typename MarlinIdx>
+void TMarlinAdaptiveCompress<TSource,MarlinIdx>::update(const BlockStats<TSource> &stats, size_t payloadSize) {
+	
+	// Only the bins the block touched change their term of historyInformation.
+	for (size_t i=0; i<stats.histogram.size(); i++) {
+		if (not stats.histogram[i]) continue;
+		historyInformation -= binInformation(history[i]);
+		history[i] += stats.histogram[i];
+		historyInformation += binInformation(history[i]);
+	}
+	historyTotal += stats.nElements;
+	symbolsSinceSwap += stats.nElements;
+	
+	const double entropy = historyTotal ? std::max(0., std::log2(double(historyTotal)) - historyInformation/historyTotal) : 0.;
+	
+	// A dictionary built for the running histogram is expected to reach the same
+	// efficiency as the current one reached for the histogram it was built from.
+	observedBits += 8.*payloadSize;
+	expectedBits += stats.nElements*entropy/current->efficiency;
+	
+	// Halving touches every bin, so historyInformation is recomputed, which also keeps
+	// rounding errors from building up.
+	while (historyTotal > historySize) {
+		historyTotal = 0;
+		historyInformation = 0;
+		for (auto &&h : history) {
+			historyTotal += (h /= 2);
+			historyInformation += binInformation(h);
+		}
+		observedBits /= 2;
+		expectedBits /= 2;
+	}
+	
+	// Once the current dictionary falls behind, the histogram restarts so that the new
+	// dictionary is built only from data that arrived after the drift.
+	if (not collecting and not builder.joinable() and symbolsSinceSwap >= historySize/2 and
+		observedBits > expectedBits*(1+retrainThreshold)) {
+		
+		history.fill(0);
+		historyTotal = 0;
+		historyInformation = 0;
+		collecting = true;
+		return;
+	}
+	
+	if (not collecting or historyTotal < historySize/2) return;
+	collecting = false;
+	
+	std::vector<uint32_t> counts(history.begin(), history.end());
+	uint32_t id = currentId + 1;
+	builder = std::thread([this, counts, id]() {
+		try {
+			next = buildAdaptiveDictionary<TSource,MarlinIdx>(id, counts, conf);
+			nextCounts = counts;
+		} catch (...) {
+			next.reset();
+		}
+		nextReady = true;
+	});
+}
+
+template<typename TSource, typename MarlinIdx>
+void TMarlinAdaptiveCompress<TSource,MarlinIdx>::swapIfReady() {
+	
+	if (not nextReady) return;
+	
+	if (builder.joinable())
+		builder.join();
+	nextReady = false;
+	if (next) {
+		current = std::move(next);
+		currentCounts = std::move(nextCounts);
+		currentId++;
+		observedBits = expectedBits = 0;
+	}
+	symbolsSinceSwap = 0;
+}
+
+template<typename TSource, typename MarlinIdx>
+void TMarlinAdaptiveCompress<TSource,MarlinIdx>::wait() {
+	
+	if (builder.joinable())
+		builder.join();
+}
+
+////////////////////////////////////////////////////////////////////////
+//
+// Decompression
+
+template<typename TSource, typename MarlinIdx>
+TMarlinAdaptiveDecompress<TSource,MarlinIdx>::TMarlinAdaptiveDecompress(
+	std::shared_ptr<const Dictionary> initial,
+	Configuration conf_) :
+	conf(conf_),
+	current(initial) {}
+
+template<typename TSource, typename MarlinIdx>
+ssize_t TMarlinAdaptiveDecompress<TSource,MarlinIdx>::decompress(View<const uint8_t> src, View<TSource> dst) {
+	
+	typedef TMarlinAdaptiveCompress<TSource,MarlinIdx> Compress;
+	
+	const uint8_t *in = src.start;
+	TSource *out = dst.start;
+	while (in < src.end) {
+		
+		uint32_t header[4];
+		if (size_t(src.end - in) < Compress::RECORD_HEADER_SIZE) return -1;
+		for (size_t i=0; i<4; i++)
+			header[i] = loadLE32(in + i*sizeof(uint32_t));
+		in += Compress::RECORD_HEADER_SIZE;
+		
+		if (header[1] & Compress::FLAG_HISTOGRAM) {
+			std::vector<uint32_t> counts(histogramEntries<TSource>());
+			if (size_t(src.end - in) < counts.size()*sizeof(uint32_t)) return -1;
+			for (auto &&c : counts) {
+				c = loadLE32(in);
+				in += sizeof(uint32_t);
+			}
+			
+			current = buildAdaptiveDictionary<TSource,MarlinIdx>(header[0], counts, conf);
+			currentId = header[0];
+		} else if (header[0] != currentId) {
+			return -1; // A dictionary we have not seen
+		}
+		
+		if (header[3] > size_t(src.end - in) or header[2] > size_t(dst.end - out)) return -1;
+		
+		ssize_t r = current->decompress(marlin::make_view(in, in+header[3]), marlin::make_view(out, out+header[2]));
+		if (r != ssize_t(header[2])) return -1;
+		in  += header[3];
+		out += header[2];
+	}
+	return out - dst.start;
+}
+
+////////////////////////////////////////////////////////////////////////
+//
+// Explicit Instantiations
+#include "instantiations.h"
+INSTANTIATE(TMarlinAdaptiveCompress)
+INSTANTIATE(TMarlinAdaptiveDecompress)
@@ -0,0 +1,75 @@
+/***********************************************************************
+
+buildTiming: time spent in each phase of building dictionaries
+
+MIT License
+
+Copyright (c) 2018 Manuel Martinez Torres
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+***********************************************************************/
+
+
+#include "buildTiming.hpp"
+
+#include <atomic>
+#include <cstdint>
+
+using namespace marlin;
+
+namespace {
+
+const char *names[] = { "marlin_alphabet", "tree", "arrange_and_fuse", "compressor_table", "decompressor_table" };
+
+std::atomic<bool> timingEnabled(false);
+std::atomic<uint64_t> nanoseconds[BUILD_PHASES];
+
+}
+
+const char *marlin::buildPhaseName(BuildPhase phase) {
+
+	return names[int(phase)];
+}
+
+void marlin::enableBuildTiming(bool enable) {
+
+	timingEnabled = enable;
+}
+
+void marlin::resetBuildTiming() {
+
+	for (auto &&ns : nanoseconds) ns = 0;
+}
+
+double marlin::buildTime(BuildPhase phase) {
+
+	return nanoseconds[int(phase)] * 1e-9;
+}
+
+BuildTimer::BuildTimer(BuildPhase phase_) : phase(phase_), enabled(timingEnabled) {
+
+	if (enabled) start = std::chrono::steady_clock::now();
+}
+
+BuildTimer::~BuildTimer() {
+
+	if (enabled)
+		nanoseconds[int(phase)] += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
@@ -0,0 +1,69 @@
+/***********************************************************************
+
+buildTiming: time spent in each phase of building dictionaries
+
+MIT License
+
+Copyright (c) 2018 Manuel Martinez Torres
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+***********************************************************************/
+
+
+#ifndef MARLIN_BUILD_TIMING_HPP
+#define MARLIN_BUILD_TIMING_HPP
+
+#include <chrono>
+
+namespace marlin {
+
+// Steps of building a dictionary (TMarlinDictionary) and the tables of its codec.
+enum class BuildPhase : int { MarlinAlphabet = 0, Tree = 1, ArrangeAndFuse = 2, CompressorTable = 3, DecompressorTable = 4 };
+constexpr int BUILD_PHASES = 5;
+
+const char *buildPhaseName(BuildPhase phase);
+
+/**
+ * Time spent in each phase since the last reset, summed over all threads: the
+ * configuration search builds its candidate dictionaries concurrently, so this is
+ * closer to CPU time than to the time the construction takes.
+ *
+ * Timing is off unless enabled (the dictionary benchmark does), as it is global to
+ * the process.
+ */
+void enableBuildTiming(bool enable);
+void resetBuildTiming();
+double buildTime(BuildPhase phase); // In seconds.
+
+// Adds the time from its construction to its destruction to phase, if timing is enabled.
+class BuildTimer {
+	const BuildPhase phase;
+	const bool enabled;
+	std::chrono::steady_clock::time_point start;
+public:
+	explicit BuildTimer(BuildPhase phase_);
+	~BuildTimer();
+	BuildTimer(const BuildTimer &) = delete;
+	void operator=(const BuildTimer &) = delete;
+};
+
+}
+
+#endif /* MARLIN_BUILD_TIMING_HPP */
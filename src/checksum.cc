@@ -0,0 +1,142 @@
+/***********************************************************************
+
+checksum: 64 bit xxHash (XXH64) of the content of a frame
+
+MIT License
+
+Copyright (c) 2017 Manuel Martinez Torres
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+***********************************************************************/
+
+#include "checksum.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace marlin;
+
+namespace {
+
+constexpr uint64_t PRIME1 = 0x9E3779B185EBCA87ULL;
+constexpr uint64_t PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr uint64_t PRIME3 = 0x165667B19E3779F9ULL;
+constexpr uint64_t PRIME4 = 0x85EBCA77C2B2AE63ULL;
+constexpr uint64_t PRIME5 = 0x27D4EB2F165667C5ULL;
+
+inline uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+inline uint64_t read64(const uint8_t *p) { uint64_t v; memcpy(&v, p, sizeof(v)); return v; }
+inline uint32_t read32(const uint8_t *p) { uint32_t v; memcpy(&v, p, sizeof(v)); return v; }
+
+inline uint64_t step(uint64_t acc, uint64_t input) {
+	
+	acc += input * PRIME2;
+	acc  = rotl(acc, 31);
+	return acc * PRIME1;
+}
+
+inline uint64_t mergeStep(uint64_t acc, uint64_t val) {
+	
+	acc ^= step(0, val);
+	return acc * PRIME1 + PRIME4;
+}
+
+// Consumes the stripes of 32 bytes in [p, end) and returns where it stopped.
+inline const uint8_t *stripes(uint64_t *v, const uint8_t *p, const uint8_t *end) {
+	
+	uint64_t v0 = v[0], v1 = v[1], v2 = v[2], v3 = v[3];
+	for (; p + 32 <= end; p += 32) {
+		v0 = step(v0, read64(p));
+		v1 = step(v1, read64(p+8));
+		v2 = step(v2, read64(p+16));
+		v3 = step(v3, read64(p+24));
+	}
+	v[0] = v0; v[1] = v1; v[2] = v2; v[3] = v3;
+	return p;
+}
+
+}
+
+XXHash64::XXHash64(uint64_t seed) {
+	
+	v[0] = seed + PRIME1 + PRIME2;
+	v[1] = seed + PRIME2;
+	v[2] = seed;
+	v[3] = seed - PRIME1;
+}
+
+void XXHash64::update(const void *data, size_t length) {
+	
+	const uint8_t *p = static_cast<const uint8_t *>(data);
+	const uint8_t *end = p + length;
+	totalLength += length;
+	
+	// Complete the stripe left over by the previous update.
+	if (bufferSize) {
+		size_t n = std::min(length, 32 - bufferSize);
+		memcpy(buffer + bufferSize, p, n);
+		bufferSize += n;
+		p += n;
+		if (bufferSize < 32) return;
+		stripes(v, buffer, buffer + 32);
+		bufferSize = 0;
+	}
+	
+	p = stripes(v, p, end);
+	
+	memcpy(buffer, p, end - p);
+	bufferSize = end - p;
+}
+
+uint64_t XXHash64::digest() const {
+	
+	uint64_t h;
+	if (totalLength >= 32) {
+		h = rotl(v[0], 1) + rotl(v[1], 7) + rotl(v[2], 12) + rotl(v[3], 18);
+		for (size_t i=0; i<4; i++)
+			h = mergeStep(h, v[i]);
+	} else {
+		h = v[2] + PRIME5; // v[2] is the seed
+	}
+	h += totalLength;
+	
+	const uint8_t *p = buffer, *end = buffer + bufferSize;
+	for (; p + 8 <= end; p += 8) {
+		h ^= step(0, read64(p));
+		h  = rotl(h, 27) * PRIME1 + PRIME4;
+	}
+	if (p + 4 <= end) {
+		h ^= uint64_t(read32(p)) * PRIME1;
+		h  = rotl(h, 23) * PRIME2 + PRIME3;
+		p += 4;
+	}
+	for (; p < end; p++) {
+		h ^= *p * PRIME5;
+		h  = rotl(h, 11) * PRIME1;
+	}
+	
+	h ^= h >> 33;
+	h *= PRIME2;
+	h ^= h >> 29;
+	h *= PRIME3;
+	h ^= h >> 32;
+	return h;
+}
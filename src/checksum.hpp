@@ -0,0 +1,55 @@
+/***********************************************************************
+
+checksum: 64 bit xxHash (XXH64) of the content of a frame
+
+MIT License
+
+Copyright (c) 2017 Manuel Martinez Torres
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+***********************************************************************/
+
+#ifndef MARLIN_CHECKSUM_HPP
+#define MARLIN_CHECKSUM_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace marlin {
+
+// XXH64 of a byte sequence that is fed in pieces of any size. It runs at several times
+// the speed of the decoder, so it can be updated with each block as soon as it is decoded.
+class XXHash64 {
+	
+	uint64_t v[4];
+	uint64_t totalLength = 0;
+	uint8_t buffer[32];
+	size_t bufferSize = 0;
+	
+public:
+	explicit XXHash64(uint64_t seed = 0);
+	
+	void update(const void *data, size_t length);
+	uint64_t digest() const;
+};
+
+}
+
+#endif /* MARLIN_CHECKSUM_HPP */
@@ -28,8 +28,54 @@ SOFTWARE.
 
 #include <marlin.h>
 
+#include <mutex>
+
+#include "parallel.hpp"
+
 using namespace marlin;
 
+namespace {
+
+// Builds the candidate configurations concurrently and returns the index of the one
+// that a sequential search would keep: each candidate has to beat the best one so far
+// by 0.01%. If stopAtPeak, the search ends at the first candidate that does not
+// improve, and later candidates are skipped as soon as that is known.
+// Returns candidates.size() if none is kept.
+template<typename TSource, typename MarlinIdx>
+size_t searchBestCandidate(const std::vector<double> &sourceAlphabet, const std::vector<Configuration> &candidates, bool stopAtPeak, size_t nThreads) {
+
+	std::vector<double> ratio(candidates.size());
+	std::vector<bool> done(candidates.size(), false);
+	std::mutex mtx;
+	
+	size_t known = 0, end = candidates.size(), ret = candidates.size();
+	double best = 0;
+	parallelFor(candidates.size(), nThreads, [&](size_t i) {
+		
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			if (i >= end) return;
+		}
+		
+		double test = TMarlinDictionary<TSource,MarlinIdx>(sourceAlphabet, candidates[i]).compressionRatio;
+		
+		std::lock_guard<std::mutex> lock(mtx);
+		ratio[i] = test;
+		done[i] = true;
+		for (; known < end and done[known]; known++) {
+			if (ratio[known] > 1.0001*best) {
+				best = ratio[known];
+				ret = known;
+			} else if (stopAtPeak) {
+				end = known;
+			}
+		}
+	});
+	return ret;
+}
+
+}
+
 template<typename TSource, typename MarlinIdx>
 std::map<std::string, double> TMarlinDictionary<TSource,MarlinIdx>::updateConf( 
 	const std::vector<double> &sourceAlphabet, 
@@ -44,6 +90,7 @@ std::map<std::string, double> TMarlinDictionary<TSource,MarlinIdx>::updateConf(
 //	conf.emplace("purgeProbabilityThreshold",0.5/4096/32);
 	conf.emplace("purgeProbabilityThreshold",0.5/4096/32);
 	conf.emplace("iterations",3);
+	conf.emplace("threads",0); // Workers used to build candidate dictionaries (0 means all cores)
 //	conf.emplace("minMarlinSymbols", std::max(1U<<size_t(conf.at("O")),2U));
 	conf.emplace("minMarlinSymbols", 2U);
 	conf.emplace("maxMarlinSymbols",(1U<<size_t(conf.at("K"))));
@@ -55,21 +102,19 @@ std::map<std::string, double> TMarlinDictionary<TSource,MarlinIdx>::updateConf(
 
 	double sourceEntropy = TMarlinDictionary<TSource,MarlinIdx>::calcSourceEntropy(sourceAlphabet);
 
+	size_t nThreads = conf.at("threads");
+
 	if (not conf.count("shift")) {
 		
-		double best = 0;
-		size_t shift = 0;
-		for (int i=0; i<6; i++) {
-			
-			auto testConf = conf;
-			testConf["shift"] = shift;
-			double test = TMarlinDictionary<TSource,MarlinIdx>(sourceAlphabet, testConf).compressionRatio;
-			if (test > 1.0001*best) {
-				best = test;
-				conf = testConf;
-			};
-			shift ++;
+		std::vector<Configuration> candidates;
+		// Wider sources keep more of their low bits as residuals.
+		for (size_t shift=0; shift<6+8*(sizeof(TSource)-1); shift++) {
+			candidates.push_back(conf);
+			candidates.back()["shift"] = shift;
 		}
+		
+		size_t best = searchBestCandidate<TSource,MarlinIdx>(sourceAlphabet, candidates, false, nThreads);
+		if (best < candidates.size()) conf = candidates[best];
 	}
 
 	conf["maxWordSize"] = maxWordSize;
@@ -78,19 +123,14 @@ std::map<std::string, double> TMarlinDictionary<TSource,MarlinIdx>::updateConf(
 		
 		conf.emplace("autoMaxWordSize",64);
 		
-		double best = 0.;
-		size_t sz = 4;
-		while (sz <= conf["autoMaxWordSize"]) {
-			
-			auto testConf = conf;
-			testConf["maxWordSize"] = sz-1;
-			double test = TMarlinDictionary<TSource,MarlinIdx>(sourceAlphabet, testConf).compressionRatio;
-			if (test > 1.0001*best) {
-				best = test;
-				conf = testConf;
-			} else break;
-			sz*=2;
+		std::vector<Configuration> candidates;
+		for (size_t sz = 4; sz <= conf["autoMaxWordSize"]; sz*=2) {
+			candidates.push_back(conf);
+			candidates.back()["maxWordSize"] = sz-1;
 		}
+		
+		size_t best = searchBestCandidate<TSource,MarlinIdx>(sourceAlphabet, candidates, true, nThreads);
+		if (best < candidates.size()) conf = candidates[best];
 	}
 	
 	//printf("%lf %lf\n", conf["maxWordSize"], conf["shift"]);
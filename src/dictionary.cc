@@ -36,19 +36,49 @@ SOFTWARE.
 #include <stack>
 #include <cmath>
 
+#include "buildTiming.hpp"
+
 using namespace marlin;
 
 namespace {
+
+// Tree of a chapter, stored as flat arrays indexed by node (node 0 is the root).
+// The children of a node are linked through nextSibling in the order they were
+// added, which is also the Marlin symbol that each of them appends to the word.
+constexpr uint32_t NO_NODE = uint32_t(-1);
+
+struct Tree {
 	
-struct Node;
-typedef std::shared_ptr<Node> SNode;	
-struct Node : std::vector<SNode> {
-	double p=0;
-	size_t sz=0;
+	std::vector<double>   p;
+	std::vector<uint32_t> sz;          // Length of the word of the node
+	std::vector<uint32_t> symbol;      // Last symbol of the word of the node
+	std::vector<uint32_t> nChildren;
+	std::vector<uint32_t> parent, firstChild, lastChild, nextSibling;
+	
+	void reserve(size_t n) {
+		p.reserve(n); sz.reserve(n); symbol.reserve(n); nChildren.reserve(n);
+		parent.reserve(n); firstChild.reserve(n); lastChild.reserve(n); nextSibling.reserve(n);
+	}
+	
+	uint32_t addNode(double p_, uint32_t sz_, uint32_t symbol_, uint32_t parent_) {
+		p.push_back(p_); sz.push_back(sz_); symbol.push_back(symbol_); nChildren.push_back(0);
+		parent.push_back(parent_); firstChild.push_back(NO_NODE); lastChild.push_back(NO_NODE); nextSibling.push_back(NO_NODE);
+		return p.size()-1;
+	}
+	
+	uint32_t addChild(uint32_t parent_, double p_) {
+		uint32_t child = addNode(p_, sz[parent_]+1, nChildren[parent_], parent_);
+		if (nChildren[parent_]++ == 0)
+			firstChild[parent_] = child;
+		else
+			nextSibling[lastChild[parent_]] = child;
+		lastChild[parent_] = child;
+		return child;
+	}
 };
 
 template<typename TSource, typename MarlinIdx>
-SNode buildTree(const TMarlinDictionary<TSource,MarlinIdx> &dictionary, std::vector<double> Pstates) {
+Tree buildTree(const TMarlinDictionary<TSource,MarlinIdx> &dictionary, std::vector<double> Pstates) {
 
 	// Normalizing the state probabilities makes the algorithm more stable
 	double factor = 1e-10;
@@ -67,149 +97,182 @@ SNode buildTree(const TMarlinDictionary<TSource,MarlinIdx> &dictionary, std::vec
 	for (size_t i=0; i<PN.size(); i++)
 		Pchild[i] = dictionary.marlinAlphabet[i].p/PN[i];
 	
-	auto cmp = [](const SNode &lhs, const SNode &rhs) { 
-		if (std::abs(lhs->p - rhs->p) > 1e-10)
-			return lhs->p<rhs->p;
+	size_t numWordsPerChapter = 1U<<dictionary.K;
+	if (dictionary.conf.count("numMarlinWords")) numWordsPerChapter = dictionary.conf.at("numMarlinWords")/(1<<dictionary.O);
+
+	Tree tree;
+	tree.reserve(2*numWordsPerChapter + dictionary.marlinAlphabet.size());
+	
+	// Queued nodes carry their probability, which does not change until they are popped.
+	typedef std::pair<double, uint32_t> QueuedNode;
+	auto cmp = [](const QueuedNode &lhs, const QueuedNode &rhs) { 
+		if (std::abs(lhs.first - rhs.first) > 1e-10)
+			return lhs.first<rhs.first;
 		return false;
 	};
-	std::priority_queue<SNode, std::vector<SNode>, decltype(cmp)> pq(cmp);
+	std::vector<QueuedNode> heap;
+	heap.reserve(2*numWordsPerChapter + dictionary.marlinAlphabet.size());
+	std::priority_queue<QueuedNode, std::vector<QueuedNode>, decltype(cmp)> pq(cmp, std::move(heap));
 
 	// DICTIONARY INITIALIZATION
-	SNode root = std::make_shared<Node>();
+	const uint32_t root = tree.addNode(1, 0, 0, NO_NODE);
 	
 	// Include empty word
 //		pq.push(root);
-	root->p = 1;
 	int retiredNodes = 0;
 	
+	// Words of one symbol are kept even if their probability is 0: the state probabilities
+	// come from the previous arrangement of the words, so the chapter may still end up
+	// holding a word that the encoder follows with any symbol (see buildCompressorTable).
 	for (size_t c=0; c<dictionary.marlinAlphabet.size(); c++) {	
 			
 		double sum = 0;
 		for (size_t t = 0; t<=c; t++) sum += Pstates[t]/PN[t];
 		
-		root->push_back(std::make_shared<Node>());
-		root->back()->p = sum * dictionary.marlinAlphabet[c].p;
-		root->p -= root->back()->p;
-		root->back()->sz = 1;
-		if (root->back()->p == 0) {
-			root->back()->p = -1;
-			retiredNodes--; // This node will eventually be eliminated, but acts now as a placeholder
-		}
-		pq.push(root->back());
+		uint32_t child = tree.addChild(root, sum * dictionary.marlinAlphabet[c].p);
+		tree.p[root] -= tree.p[child];
+		pq.emplace(tree.p[child], child);
 	}
 		
 	// DICTIONARY GROWING
-	size_t numWordsPerChapter = 1U<<dictionary.K;
-	if (dictionary.conf.count("numMarlinWords")) numWordsPerChapter = dictionary.conf.at("numMarlinWords")/(1<<dictionary.O);
 	while (not pq.empty() and (pq.size() + retiredNodes < numWordsPerChapter)) {
 			
-		SNode node = pq.top();
+		uint32_t node = pq.top().second;
 		pq.pop();
 		
 		// retire words larger than maxWordSize that are meant to be extended by a symbol different than zero.
-		if (node->sz >= dictionary.maxWordSize and not node->empty()) {
+		if (tree.sz[node] >= dictionary.maxWordSize and tree.nChildren[node]) {
 			retiredNodes++;
 			continue;
 		}
 
-		if (node->sz == 255) {
+		if (tree.sz[node] == 255) {
 			retiredNodes++;
 			continue;
 		}
 		
-		if (node->size() == dictionary.marlinAlphabet.size()) {
+		if (tree.nChildren[node] == dictionary.marlinAlphabet.size()) {
 			retiredNodes++;
 			continue;					
 		}
 		
-		double p = node->p * Pchild[node->size()];
-		node->push_back(std::make_shared<Node>());
-		node->back()->p = p;
-		node->back()->sz = node->sz+1;
-		pq.push(node->back());
-		node->p -= p;
-		pq.push(node);
+		double p = tree.p[node] * Pchild[tree.nChildren[node]];
+		pq.emplace(p, tree.addChild(node, p));
+		tree.p[node] -= p;
+		pq.emplace(tree.p[node], node);
 	}
 
 	// Renormalize probabilities.
-	{
-		std::queue<SNode> q(std::deque<SNode>{ root });
-		double sum=0, num=0;
-		while (not q.empty()) {
-			sum += q.front()->p; num++;
-			q.front()->p *= factor;
-			for (auto &&child : *q.front()) 
-				q.push(child);
-			q.pop();
-		}
-		//std::cerr << sum << " sum - num " << num << std::endl;
-	}
-	return root;
+	for (auto &&p : tree.p)
+		p *= factor;
+
+	return tree;
 }
 
 
-template<typename TSource, typename MarlinIdx, typename Word = typename TMarlinDictionary<TSource,MarlinIdx>::Word>
-std::vector<Word> buildChapterWords(const TMarlinDictionary<TSource,MarlinIdx> &, const SNode root) {
+// Nodes with a valid word, depth first with the children visited from the last one.
+std::vector<uint32_t> depthFirstNodes(const Tree &tree) {
 
-	std::vector<Word> ret;
+	std::vector<uint32_t> ret, stack;
+	ret.reserve(tree.p.size());
+	stack.reserve(tree.p.size());
+	stack.push_back(0);
 	
-	std::stack<std::pair<SNode, Word>> q;
-	Word rootWord;
-	rootWord.p = root->p;
-	q.emplace(root, rootWord);
+	while (not stack.empty()) {
+		uint32_t n = stack.back();
+		stack.pop_back();
+		
+		if (n != 0 and tree.p[n]>=0)
+			ret.push_back(n);
+		
+		for (uint32_t child = tree.firstChild[n]; child != NO_NODE; child = tree.nextSibling[child])
+			stack.push_back(child);
+	}
+	return ret;
+}
+
+// Position of the word of each node in lexicographic order. A prefix sorts before
+// its extensions, so this is a preorder traversal visiting children by symbol.
+// Children are always added after their parent, so their index is larger.
+std::vector<uint32_t> lexicographicRank(const Tree &tree) {
+
+	std::vector<uint32_t> subtreeSize(tree.p.size(), 1);
+	for (size_t n = tree.p.size()-1; n; n--)
+		subtreeSize[tree.parent[n]] += subtreeSize[n];
 	
-	while (not q.empty()) {
-		SNode n = q.top().first;
-		Word w = q.top().second;
-		q.pop();
-		if (not w.empty() and w.p>=0)
-			ret.push_back(w);
-		for (size_t i = 0; i<n->size(); i++) {
-			
-			Word w2 = w;
-//				w2.push_back(marlinAlphabet[i].sourceSymbol);
-			w2.push_back(i);
-			w2.p = n->at(i)->p;
-			w2.state = n->at(i)->size();
-			
-			assert(n->at(i)->sz == w2.size());
-			q.emplace(n->at(i), w2);
+	std::vector<uint32_t> rank(tree.p.size(), 0);
+	for (size_t n = 0; n < tree.p.size(); n++) {
+		uint32_t next = rank[n] + 1;
+		for (uint32_t child = tree.firstChild[n]; child != NO_NODE; child = tree.nextSibling[child]) {
+			rank[child] = next;
+			next += subtreeSize[child];
 		}
 	}
+	return rank;
+}
+
+
+// A chapter tree along with where each of its words is placed: slot j of the
+// chapter holds the word of node slots[j], or the empty word if it is NO_NODE.
+struct Chapter {
+	
+	Tree tree;
+	std::vector<uint32_t> slots;
+};
+
+template<typename TSource, typename MarlinIdx>
+Chapter arrange(const TMarlinDictionary<TSource,MarlinIdx> &dictionary, Tree tree) {
+
+	Chapter ret;
+	ret.tree = std::move(tree);
+	const Tree &t = ret.tree;
 	
-	//std::cout << ret.size() << std::endl;
+	// Nodes are sorted instead of words, the words are only built once fused.
+	struct SortKey { uint32_t state, rank, node; double p; };
+	std::vector<SortKey> sortedDictionary;
+	std::vector<uint32_t> rank = lexicographicRank(t);
+	for (auto &&n : depthFirstNodes(t))
+		sortedDictionary.push_back(SortKey{t.nChildren[n], rank[n], n, t.p[n]});
+
+	auto cmp = [](const SortKey &lhs, const SortKey &rhs) { 
+		if (lhs.state != rhs.state) return lhs.state<rhs.state;
+		if (std::abs(lhs.p-rhs.p)/(lhs.p+rhs.p) > 1e-10) return lhs.p > rhs.p;
+		return lhs.rank<rhs.rank;
+	};
+	std::stable_sort(sortedDictionary.begin(), sortedDictionary.end(), cmp);
+
+	size_t numWordsPerChapter = 1U<<dictionary.K;
+	if (dictionary.conf.count("numMarlinWords")) numWordsPerChapter = dictionary.conf.at("numMarlinWords")/(1<<dictionary.O);
+	ret.slots.resize(numWordsPerChapter, NO_NODE);
+	for (size_t i=0,j=0,k=0; i<sortedDictionary.size(); j+=(1U<<dictionary.O)) {
+		
+		if (j>=ret.slots.size()) 
+			j=++k;
+
+		ret.slots[j] = sortedDictionary[i++].node;
+	}
 	return ret;
 }
 
 
 template<typename TSource, typename MarlinIdx, typename Word = typename TMarlinDictionary<TSource,MarlinIdx>::Word>
-std::vector<Word> arrangeAndFuse(const TMarlinDictionary<TSource,MarlinIdx> &dictionary, const std::vector<SNode> chapters) {
+std::vector<Word> fuse(const TMarlinDictionary<TSource,MarlinIdx> &, const std::vector<Chapter> &chapters) {
 
 	std::vector<Word> ret;
 	for (auto &&chapter : chapters) {
-		
-		std::vector<Word> sortedDictionary = buildChapterWords(dictionary,chapter);
-		
-		auto cmp = [](const Word &lhs, const Word &rhs) { 
-			if (lhs.state != rhs.state) return lhs.state<rhs.state;
-			if (std::abs(lhs.p-rhs.p)/(lhs.p+rhs.p) > 1e-10) return lhs.p > rhs.p;
-			return lhs<rhs;
-		};
-		// Note the +1, we keep the empty word in the first position.
-//			std::stable_sort(sortedDictionary.begin()+1, sortedDictionary.end(), cmp);
-		std::stable_sort(sortedDictionary.begin(), sortedDictionary.end(), cmp);
-
-		size_t numWordsPerChapter = 1U<<dictionary.K;
-		if (dictionary.conf.count("numMarlinWords")) numWordsPerChapter = dictionary.conf.at("numMarlinWords")/(1<<dictionary.O);
-		std::vector<Word> w(numWordsPerChapter,Word());
-		for (size_t i=0,j=0,k=0; i<sortedDictionary.size(); j+=(1U<<dictionary.O)) {
+		const Tree &tree = chapter.tree;
+		for (auto &&n : chapter.slots) {
 			
-			if (j>=w.size()) 
-				j=++k;
-
-			w[j] = sortedDictionary[i++];
+			ret.emplace_back();
+			if (n == NO_NODE) continue;
+			
+			Word &w = ret.back();
+			w.resize(tree.sz[n]);
+			for (uint32_t node = n; node; node = tree.parent[node])
+				w[tree.sz[node]-1] = tree.symbol[node];
+			w.p = tree.p[n];
+			w.state = tree.nChildren[n];
 		}
-		ret.insert(ret.end(), w.begin(), w.end());
 	}
 	return ret;
 }
@@ -255,6 +318,14 @@ void print(const TMarlinDictionary<TSource,MarlinIdx> &dictionary, std::vector<W
 }
 
 
+template<typename TSource, typename MarlinIdx>
+void print(const TMarlinDictionary<TSource,MarlinIdx> &dictionary, const std::vector<Chapter> &chapters) {
+
+	if (dictionary.conf.at("debug")<3) return;
+	print(dictionary, fuse(dictionary, chapters));
+}
+
+
 template<typename TSource, typename MarlinIdx>
 void print(const TMarlinDictionary<TSource,MarlinIdx> &dictionary, std::vector<std::vector<double>> Pstates) {
 	
@@ -292,6 +363,8 @@ std::vector<double> TMarlinDictionary<TSource,MarlinIdx>::sanitizeAlphabet(const
 template<typename TSource, typename MarlinIdx>
 auto TMarlinDictionary<TSource,MarlinIdx>::buildMarlinAlphabet() const -> MarlinAlphabet {
 	
+	BuildTimer timer(BuildPhase::MarlinAlphabet);
+	
 	// Group symbols by their high bits
 	std::map<TSource, double> symbolsShifted;
 	for (size_t i=0; i<sourceAlphabet.size(); i++)
@@ -387,13 +460,21 @@ auto TMarlinDictionary<TSource,MarlinIdx>::buildDictionary() const -> std::vecto
 		Pstates.push_back(PstatesSingle);
 	}
 	
-	std::vector<SNode> dictionaries;
+	auto buildChapter = [&](size_t k) {
+		Tree tree;
+		{
+			BuildTimer timer(BuildPhase::Tree);
+			tree = buildTree(*this,Pstates[k]);
+		}
+		BuildTimer timer(BuildPhase::ArrangeAndFuse);
+		return arrange(*this,std::move(tree));
+	};
+	
+	std::vector<Chapter> chapters;
 	for (size_t k=0; k<(1U<<O); k++)
-		dictionaries.push_back(buildTree(*this,Pstates[k]));
+		chapters.push_back(buildChapter(k));
 		
-	std::vector<Word> ret = arrangeAndFuse(*this,dictionaries);
-		
-	print(*this,ret);
+	print(*this,chapters);
 	
 	size_t iterations = conf.at("iterations");
 		
@@ -405,26 +486,28 @@ auto TMarlinDictionary<TSource,MarlinIdx>::buildDictionary() const -> std::vecto
 				for (auto &&p : pk)
 					p = 0.;
 
-			for (size_t i=0; i<ret.size(); i++) {
-				Pstates[i%(1U<<O)][ret[i].state] += ret[i].p;
+			for (size_t c=0, i=0; c<chapters.size(); c++) {
+				for (auto &&n : chapters[c].slots) {
+					if (n != NO_NODE)
+						Pstates[i%(1U<<O)][chapters[c].tree.nChildren[n]] += chapters[c].tree.p[n];
+					i++;
+				}
 			}
 		}
 		
 		print(*this,Pstates);
 
-		dictionaries.clear();
 		for (size_t k=0; k<(1U<<O); k++)
-			dictionaries.push_back(buildTree(*this,Pstates[k]));
+			chapters[k] = buildChapter(k);
 		
-		ret = arrangeAndFuse(*this,dictionaries);
-		
-		print(*this,ret);
+		print(*this,chapters);
 		//if (conf.at("debug")>2) printf("Efficiency: %3.4lf\n", calcEfficiency(ret));		
 	}
 	if (conf.at("debug")>1) for (auto &&c : conf) std::cout << c.first << ": " << c.second << std::endl;
 	//if (conf.at("debug")>0) printf("Efficiency: %3.4lf\n", calcEfficiency(ret));
 
-	return ret;
+	BuildTimer timer(BuildPhase::ArrangeAndFuse);
+	return fuse(*this,chapters);
 }
 
 ////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,240 @@
+/***********************************************************************
+
+dictionaryFile: binary dictionary format that can be used in place from a mapped file
+
+MIT License
+
+Copyright (c) 2017 Manuel Martinez Torres
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+***********************************************************************/
+
+
+#include <marlin.h>
+
+#include <fstream>
+#include <cstring>
+#include <cmath>
+#include <limits>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace marlin;
+
+// File layout (all values in host byte order):
+//   FileHeader
+//   name                  nameSize bytes
+//   source2marlin         1<<(8*sizeof(TSource)) MarlinIdx
+//   compressorTable       compressorTableSize uint32_t
+//   compressorTableInit   compressorTableInitSize uint32_t
+//   decompressorTable     decompressorTableSize TSource
+// Every section starts at a multiple of ALIGNMENT bytes, and is followed by zeros up to
+// the next one, so the tables can be used straight from the mapping.
+
+namespace {
+
+constexpr char MAGIC[8] = {'M','A','R','L','I','N','D','C'};
+constexpr uint32_t VERSION = 1;
+constexpr uint32_t BYTE_ORDER_MARK = 0x01020304;
+constexpr size_t ALIGNMENT = 64;
+
+struct FileHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t byteOrderMark;
+	uint32_t sourceBytes, marlinIdxBytes;
+	uint32_t K, O, shift, maxWordSize;
+	uint32_t unrepresentedSymbolToken;
+	uint32_t marlinMostCommonSymbol;
+	uint32_t isSkip;
+	uint32_t reserved;
+	double efficiency;
+	uint64_t nameOffset, nameSize;
+	uint64_t source2marlinOffset;
+	uint64_t compressorTableOffset, compressorTableSize;
+	uint64_t compressorTableInitOffset, compressorTableInitSize;
+	uint64_t decompressorTableOffset, decompressorTableSize;
+	uint64_t fileSize;
+};
+
+size_t align(size_t offset) { return (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT; }
+
+// Table sizes implied by the dictionary parameters (see JumpTable and buildDecompressorTable).
+size_t compressorTableSize(size_t K, size_t O, size_t unrepresentedSymbolToken) {
+	return (size_t(1)<<(K+O)) << size_t(std::ceil(std::log2(unrepresentedSymbolToken+1)));
+}
+
+size_t decompressorTableSize(size_t K, size_t O, size_t maxWordSize) {
+	return (size_t(1)<<(K+O)) * (maxWordSize+1);
+}
+
+}
+
+template<typename TSource, typename MarlinIdx>
+bool TMarlin<TSource,MarlinIdx>::save(const std::string &path) const {
+	
+	typedef typename TMarlinCompress<TSource,MarlinIdx>::CompressorTableIdx TableIdx;
+	
+	// Dictionaries built from a pointer (prebuilt or loaded) do not know the size of
+	// their tables, but it follows from their parameters.
+	const size_t nCompressor = this->compressorTableVector ? 
+		this->compressorTableVector->size() : compressorTableSize(K, O, this->unrepresentedSymbolToken);
+	const size_t nCompressorInit = this->compressorTableInitVector ? 
+		this->compressorTableInitVector->size() : size_t(this->unrepresentedSymbolToken);
+	const size_t nDecompressor = this->decompressorTableVector ? 
+		this->decompressorTableVector->size() : decompressorTableSize(K, O, maxWordSize);
+	
+	FileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, MAGIC, sizeof(MAGIC));
+	header.version = VERSION;
+	header.byteOrderMark = BYTE_ORDER_MARK;
+	header.sourceBytes = sizeof(TSource);
+	header.marlinIdxBytes = sizeof(MarlinIdx);
+	header.K = K;
+	header.O = O;
+	header.shift = shift;
+	header.maxWordSize = maxWordSize;
+	header.unrepresentedSymbolToken = this->unrepresentedSymbolToken;
+	header.marlinMostCommonSymbol = this->marlinMostCommonSymbol;
+	header.isSkip = this->isSkip;
+	header.efficiency = this->efficiency;
+	header.nameOffset = align(sizeof(FileHeader));
+	header.nameSize = name.size();
+	header.source2marlinOffset = align(header.nameOffset + header.nameSize);
+	header.compressorTableOffset = align(header.source2marlinOffset + sizeof(this->source2marlin));
+	header.compressorTableSize = nCompressor;
+	header.compressorTableInitOffset = align(header.compressorTableOffset + nCompressor*sizeof(TableIdx));
+	header.compressorTableInitSize = nCompressorInit;
+	header.decompressorTableOffset = align(header.compressorTableInitOffset + nCompressorInit*sizeof(TableIdx));
+	header.decompressorTableSize = nDecompressor;
+	header.fileSize = align(header.decompressorTableOffset + nDecompressor*sizeof(TSource));
+	
+	std::ofstream out(path, std::ios::binary | std::ios::trunc);
+	
+	auto section = [&out](size_t offset, const void *data, size_t size) {
+		static const char zeros[ALIGNMENT] = {};
+		out.write(zeros, offset - size_t(out.tellp()));
+		out.write(static_cast<const char *>(data), size);
+	};
+	section(0, &header, sizeof(header));
+	section(header.nameOffset, name.data(), name.size());
+	section(header.source2marlinOffset, this->source2marlin.data(), sizeof(this->source2marlin));
+	section(header.compressorTableOffset, this->compressorTablePointer, nCompressor*sizeof(TableIdx));
+	section(header.compressorTableInitOffset, this->compressorTableInitPointer, nCompressorInit*sizeof(TableIdx));
+	section(header.decompressorTableOffset, this->decompressorTablePointer, nDecompressor*sizeof(TSource));
+	section(header.fileSize, nullptr, 0);
+	
+	return out.good();
+}
+
+template<typename TSource, typename MarlinIdx>
+std::unique_ptr<TMarlin<TSource,MarlinIdx>> TMarlin<TSource,MarlinIdx>::load(const std::string &path) {
+	
+	typedef typename TMarlinCompress<TSource,MarlinIdx>::CompressorTableIdx TableIdx;
+	
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) return nullptr;
+	
+	struct stat st;
+	if (fstat(fd, &st) != 0 or size_t(st.st_size) < sizeof(FileHeader)) {
+		close(fd);
+		return nullptr;
+	}
+	const size_t fileSize = st.st_size;
+	
+	void *map = mmap(nullptr, fileSize, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) return nullptr;
+	
+	std::shared_ptr<const void> storage(map, [fileSize](const void *p) { munmap(const_cast<void *>(p), fileSize); });
+	const uint8_t *base = static_cast<const uint8_t *>(map);
+	
+	FileHeader header;
+	memcpy(&header, base, sizeof(header));
+	
+	auto fits = [fileSize](uint64_t offset, uint64_t size) { 
+		return offset % ALIGNMENT == 0 and offset <= fileSize and size <= fileSize - offset; 
+	};
+	
+	if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) or 
+		header.version != VERSION or 
+		header.byteOrderMark != BYTE_ORDER_MARK or
+		header.sourceBytes != sizeof(TSource) or 
+		header.marlinIdxBytes != sizeof(MarlinIdx) or
+		header.fileSize != fileSize or
+		header.K + header.O > 24 or 
+		header.shift >= 8*sizeof(TSource) or
+		header.maxWordSize == 0 or
+		header.unrepresentedSymbolToken == 0 or 
+		header.unrepresentedSymbolToken > (1ULL<<(8*sizeof(TSource)-header.shift)) or
+		header.unrepresentedSymbolToken > std::numeric_limits<MarlinIdx>::max() or
+		header.marlinMostCommonSymbol > (1ULL<<(8*sizeof(TSource)))-1 or
+		header.isSkip > 1 or
+		header.compressorTableSize < compressorTableSize(header.K, header.O, header.unrepresentedSymbolToken) or
+		header.compressorTableInitSize < header.unrepresentedSymbolToken or
+		header.decompressorTableSize < decompressorTableSize(header.K, header.O, header.maxWordSize) or
+		header.nameSize > fileSize or
+		header.compressorTableSize > fileSize or 
+		header.compressorTableInitSize > fileSize or 
+		header.decompressorTableSize > fileSize or
+		not fits(header.nameOffset, header.nameSize) or
+		not fits(header.source2marlinOffset, sizeof(std::array<MarlinIdx, 1U<<(sizeof(TSource)*8)>)) or
+		not fits(header.compressorTableOffset, header.compressorTableSize*sizeof(TableIdx)) or
+		not fits(header.compressorTableInitOffset, header.compressorTableInitSize*sizeof(TableIdx)) or
+		not fits(header.decompressorTableOffset, header.decompressorTableSize*sizeof(TSource)))
+		return nullptr;
+	
+	std::array<MarlinIdx, 1U<<(sizeof(TSource)*8)> source2marlin_;
+	memcpy(source2marlin_.data(), base + header.source2marlinOffset, sizeof(source2marlin_));
+	for (auto &&ms : source2marlin_)
+		if (ms > header.unrepresentedSymbolToken) return nullptr;
+	
+	// Skip decoders advance the output by the size of each word without bounds checks,
+	// so no word of a skip dictionary may be longer than maxWordSize.
+	const TSource *decompressorTable = reinterpret_cast<const TSource *>(base + header.decompressorTableOffset);
+	if (header.isSkip)
+		for (size_t w=0; w<(size_t(1)<<(header.K+header.O)); w++)
+			if (decompressorTable[w*(header.maxWordSize+1)+header.maxWordSize] > header.maxWordSize) return nullptr;
+	
+	return std::unique_ptr<TMarlin>(new TMarlin(
+		std::string(reinterpret_cast<const char *>(base + header.nameOffset), header.nameSize),
+		header.K, header.O, header.shift, header.maxWordSize, header.efficiency,
+		header.unrepresentedSymbolToken,
+		source2marlin_,
+		reinterpret_cast<const TableIdx *>(base + header.compressorTableOffset),
+		reinterpret_cast<const TableIdx *>(base + header.compressorTableInitOffset),
+		decompressorTable,
+		header.marlinMostCommonSymbol,
+		header.isSkip,
+		storage));
+}
+
+////////////////////////////////////////////////////////////////////////
+//
+// Explicit Instantiations
+// (TMarlin itself is instantiated in estimate.cc)
+template bool marlin::TMarlin<uint8_t,uint8_t>::save(const std::string &path) const;
+template auto marlin::TMarlin<uint8_t,uint8_t>::load(const std::string &path) -> std::unique_ptr<TMarlin>;
+template bool marlin::TMarlin<uint16_t,uint8_t>::save(const std::string &path) const;
+template auto marlin::TMarlin<uint16_t,uint8_t>::load(const std::string &path) -> std::unique_ptr<TMarlin>;
@@ -0,0 +1,77 @@
+/***********************************************************************
+
+dispatch: selection of CPU specific kernels at runtime
+
+MIT License
+
+Copyright (c) 2018 Manuel Martinez Torres
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+***********************************************************************/
+
+#include "dispatch.hpp"
+
+#include <cstdlib>
+#include <cstring>
+
+using namespace marlin;
+
+namespace {
+
+const char *names[] = { "scalar", "bmi2", "avx2", "avx512" };
+
+CpuLevel detectCpuLevel() {
+
+	__builtin_cpu_init();
+
+	CpuLevel level = CpuLevel::Scalar;
+	if (__builtin_cpu_supports("bmi2"))
+		level = CpuLevel::BMI2;
+	if (level == CpuLevel::BMI2 and __builtin_cpu_supports("avx2"))
+		level = CpuLevel::AVX2;
+	if (level == CpuLevel::AVX2 and __builtin_cpu_supports("avx512f") and __builtin_cpu_supports("avx512bw"))
+		level = CpuLevel::AVX512;
+
+	const char *cap = getenv("MARLIN_CPU_LEVEL");
+	if (cap != nullptr)
+		for (int l = 0; l < int(level); l++)
+			if (not strcmp(cap, names[l]))
+				level = CpuLevel(l);
+
+	return level;
+}
+
+}
+
+CpuLevel marlin::cpuLevel() {
+
+	static const CpuLevel level = detectCpuLevel();
+	return level;
+}
+
+bool marlin::cpuSupports(CpuLevel level) {
+
+	return int(level) <= int(cpuLevel());
+}
+
+const char *marlin::cpuLevelName(CpuLevel level) {
+
+	return names[int(level)];
+}
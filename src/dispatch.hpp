@@ -0,0 +1,60 @@
+/***********************************************************************
+
+dispatch: selection of CPU specific kernels at runtime
+
+MIT License
+
+Copyright (c) 2018 Manuel Martinez Torres
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+***********************************************************************/
+
+#ifndef MARLIN_DISPATCH_HPP
+#define MARLIN_DISPATCH_HPP
+
+// Kernels are written once as always inlined templates and instantiated inside
+// thin wrappers compiled for each instruction set level.
+#define MARLIN_INLINE        inline __attribute__ ((always_inline))
+// Lambdas inside kernels need it too, or they may end up as calls to generic code.
+#define MARLIN_INLINE_LAMBDA __attribute__ ((always_inline))
+#define MARLIN_TARGET_BMI2   __attribute__ ((target ("bmi,bmi2,lzcnt")))
+#define MARLIN_TARGET_AVX2   __attribute__ ((target ("avx2,bmi,bmi2,lzcnt")))
+#define MARLIN_TARGET_AVX512 __attribute__ ((target ("avx512f,avx512bw,avx2,bmi,bmi2,lzcnt")))
+
+namespace marlin {
+
+enum class CpuLevel : int { Scalar = 0, BMI2 = 1, AVX2 = 2, AVX512 = 3 };
+
+/**
+ * Highest instruction set level supported by the running CPU. Resolved once per process.
+ *
+ * Setting the MARLIN_CPU_LEVEL environment variable to scalar, bmi2, avx2 or avx512
+ * caps the level (useful to test or compare kernels on a single machine).
+ */
+CpuLevel cpuLevel();
+
+/// True if kernels of the given level can run on this process.
+bool cpuSupports(CpuLevel level);
+
+const char *cpuLevelName(CpuLevel level);
+
+}
+
+#endif /* MARLIN_DISPATCH_HPP */
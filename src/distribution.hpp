@@ -94,6 +94,15 @@ public:
 		return A;
 	}
 
+	// Pdf over the alphabet of TSource; 16 bit sources take 12 bit symbols.
+	template<typename TSource>
+	static inline std::vector<double> sourcePdf(Type type, double h) {
+
+		auto P = pdf(sizeof(TSource)==1 ? 256 : 4096, type, h);
+		P.resize(1U<<(8*sizeof(TSource)), 0.);
+		return P;
+	}
+
 	static inline std::vector<uint8_t> getResiduals(const std::vector<double> &pdf, size_t S) {
 
 		int8_t cdf[0x10000];
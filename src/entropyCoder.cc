@@ -34,6 +34,12 @@ SOFTWARE.
 #include <cmath>
 
 #include "profiler.hpp"
+#include "buildTiming.hpp"
+#include "dispatch.hpp"
+#include "frame.hpp"
+#include "kernels.hpp"
+#include "parallel.hpp"
+#include "residuals.hpp"
 
 #define   LIKELY(condition) (__builtin_expect(static_cast<bool>(condition), 1))
 #define UNLIKELY(condition) (__builtin_expect(static_cast<bool>(condition), 0))
@@ -42,25 +48,32 @@ using namespace marlin;
 
 namespace {
 
-
-template<typename TSource, typename MarlinIdx>
-__attribute__ ((target ("bmi2")))
-ssize_t shift8(const TMarlinCompress<TSource,MarlinIdx> &compressor, View<const TSource> src, View<uint8_t> dst) {
+// Compares 16 bytes at a time with the first symbol repeated, stopping at the first
+// vector that differs. Blocks that are one symbol except near their end are common
+// enough (e.g. a flat image with a border) that a scalar scan shows up next to encoding.
+template<typename TSource>
+bool isSingleSymbol(View<const TSource> src) {
 	
-	uint64_t mask=0;
-	for (size_t i=0; i<8; i++)
-		mask |= ((1ULL<<compressor.shift)-1)<<(8ULL*i);
+	constexpr size_t VECTOR = 16/sizeof(TSource);
+	TSource pattern[VECTOR];
+	std::fill(pattern, pattern+VECTOR, src.start[0]);
+	const __m128i first = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pattern));
+	
+	const TSource *in = src.start;
+	for (; in + VECTOR <= src.end; in += VECTOR) {
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, first)) != 0xFFFF) return false;
+	}
+	for (; in < src.end; in++)
+		if (*in != src.start[0]) return false;
+	return true;
+}
 
-	const uint64_t *i64    = reinterpret_cast<const uint64_t *>(src.start);
-	const uint64_t *i64end = reinterpret_cast<const uint64_t *>(src.end);
 
-	uint8_t *o8 = dst.start;
+template<typename TSource, typename MarlinIdx>
+ssize_t shift8(const TMarlinCompress<TSource,MarlinIdx> &compressor, View<const TSource> src, View<uint8_t> dst) {
 	
-	while (i64 != i64end) {
-		*reinterpret_cast<uint64_t *>(o8) = _pext_u64(*i64++, mask);
-		o8 += compressor.shift;
-	}
-	return o8 - dst.start;
+	return packResiduals(src.start, src.nElements(), dst.start, compressor.shift);
 }
 
 
@@ -89,8 +102,31 @@ public:
 };
 
 
+// Positions of unrepresented symbols found by the unchecked loops, kept in a fixed buffer
+// instead of growing the vector inside the loop. The loops run in batches of at most
+// BATCH symbols, and flush the positions after each one. (The count is a local of the
+// caller so that it stays in a register.)
+struct UnrepresentedPositions {
+	constexpr static const size_t BATCH = 256;
+	size_t pos[BATCH];
+
+	template<typename MarlinIdx>
+	MARLIN_INLINE MarlinIdx filter(size_t &n, MarlinIdx ms, MarlinIdx unrepresentedSymbolToken, size_t idx) {
+		if (UNLIKELY(ms==unrepresentedSymbolToken)) {
+			pos[n++] = idx;
+			ms = 0; // 0 must be always the most probable symbol;
+		}
+		return ms;
+	}
+
+	void flush(size_t &n, std::vector<size_t> &unrepresentedSymbols) const {
+		unrepresentedSymbols.insert(unrepresentedSymbols.end(), pos, pos+n);
+		n = 0;
+	}
+};
+
 template<typename TSource, typename MarlinIdx>
-ssize_t compressMarlin8 (
+MARLIN_INLINE ssize_t compressMarlin8 (
 	const TMarlinCompress<TSource,MarlinIdx> &compressor,
 	View<const TSource> src, 
 	View<uint8_t> dst, 
@@ -118,6 +154,39 @@ ssize_t compressMarlin8 (
 		j = compressor.compressorTableInitPointer[ms];
 	}
 
+	// Every symbol emits at most one byte, so while at least 16 bytes plus one per pending
+	// symbol remain, the capacity check can not fail and runs once per batch.
+	{
+		// Stores to out and unrepresented could alias the compressor, so its fields are copied.
+		const size_t shift = compressor.shift;
+		const MarlinIdx unrepresentedSymbolToken = compressor.unrepresentedSymbolToken;
+		const MarlinIdx *source2marlin = compressor.source2marlin.data();
+		const auto *table = compressor.compressorTablePointer;
+
+		UnrepresentedPositions unrepresented;
+		size_t nUnrepresented = 0;
+		for (;;) {
+			size_t n = std::min(size_t(src.end-in), size_t(std::max(dst.end-out-16, ptrdiff_t(0))));
+			n = std::min(n, size_t(UnrepresentedPositions::BATCH));
+			if (n < 4) break;
+
+			auto step = [&]() MARLIN_INLINE_LAMBDA {
+				MarlinIdx ms = unrepresented.filter(nUnrepresented, source2marlin[(*in)>>shift], unrepresentedSymbolToken, in-src.start);
+				in++;
+				*out = j & 0xFF;
+				j = jump(table, j, ms);
+				out += j >> (8*sizeof(j)-1); // FLAG_NEXT_WORD
+			};
+
+			for (; n>=4; n-=4) {
+				step(); step(); step(); step();
+			}
+			for (; n; n--)
+				step();
+			unrepresented.flush(nUnrepresented, unrepresentedSymbols);
+		}
+	}
+
 	MarlinIdx ms;
 	while (in<src.end) {
 		
@@ -146,7 +215,7 @@ ssize_t compressMarlin8 (
 }
 
 template<typename TSource, typename MarlinIdx>
-ssize_t compressMarlinFast(
+MARLIN_INLINE ssize_t compressMarlinFast(
 	const TMarlinCompress<TSource,MarlinIdx> &compressor,
 	View<const TSource> src, 
 	View<uint8_t> dst, 
@@ -177,6 +246,53 @@ ssize_t compressMarlinFast(
 
 	uint32_t value = 0;
 	int32_t valueBits = 0;
+
+	// Every symbol adds at most K bits, so the capacity check below can only fail once
+	// fewer than 17 bytes plus K bits per pending symbol remain.
+	{
+		// Stores to out and unrepresented could alias the compressor, so its fields are copied.
+		const size_t K = compressor.K, shift = compressor.shift;
+		const MarlinIdx unrepresentedSymbolToken = compressor.unrepresentedSymbolToken;
+		const MarlinIdx *source2marlin = compressor.source2marlin.data();
+		const auto *table = compressor.compressorTablePointer;
+
+		UnrepresentedPositions unrepresented;
+		size_t nUnrepresented = 0;
+		for (;;) {
+			ptrdiff_t room = dst.end-out-17;
+			size_t n = std::min(size_t(src.end-in), size_t(std::max(room, ptrdiff_t(0)))*8/K);
+			n = std::min(n, size_t(UnrepresentedPositions::BATCH));
+			if (n < 4) break;
+
+			auto step = [&]() MARLIN_INLINE_LAMBDA {
+				MarlinIdx ms = unrepresented.filter(nUnrepresented, source2marlin[(*in)>>shift], unrepresentedSymbolToken, in-src.start);
+				in++;
+				
+				auto jOld = j;
+				j = jump(table, j, ms);
+				
+				uint32_t emit = -uint32_t(j >> (8*sizeof(j)-1)); // FLAG_NEXT_WORD
+				value |= (((jOld | compressor.FLAG_NEXT_WORD) ^ compressor.FLAG_NEXT_WORD) << (32 - K - valueBits)) & emit;
+				valueBits += K & emit;
+				
+				// Flushes whole bytes, keeping between 1 and 8 bits pending, as the checked loop does.
+				int32_t nBytes = std::max(valueBits-1, 0) >> 3;
+				uint32_t be = __builtin_bswap32(value);
+				memcpy(out, &be, sizeof(be));
+				out += nBytes;
+				value = uint32_t(uint64_t(value) << (8*nBytes));
+				valueBits -= 8*nBytes;
+			};
+
+			for (; n>=4; n-=4) {
+				step(); step(); step(); step();
+			}
+			for (; n; n--)
+				step();
+			unrepresented.flush(nUnrepresented, unrepresentedSymbols);
+		}
+	}
+
 	while (in<src.end) {
 		
 		if (dst.end-out<16) return -1;	// TODO: find the exact value
@@ -218,11 +334,128 @@ ssize_t compressMarlinFast(
 	return out - dst.start;
 }	
 
+template<typename TSource, typename MarlinIdx>
+MARLIN_INLINE ssize_t encodeMarlin(
+	const TMarlinCompress<TSource,MarlinIdx> &compressor,
+	View<const TSource> src, 
+	View<uint8_t> dst, 
+	std::vector<size_t> &unrepresentedSymbols)
+{
+	if (false) {
+		//return compressMarlinReference(src, dst, unrepresentedSymbols);
+	} else if (compressor.K==8) {
+		return compressMarlin8(compressor, src, dst, unrepresentedSymbols);
+	} else {
+		return compressMarlinFast(compressor, src, dst, unrepresentedSymbols);
+	}
+}
+
+// The same encoder compiled for each instruction set level (see dispatch.hpp).
+template<typename TSource, typename MarlinIdx>
+ssize_t encodeMarlinScalar(const TMarlinCompress<TSource,MarlinIdx> &compressor, View<const TSource> src, View<uint8_t> dst, std::vector<size_t> &unrepresentedSymbols) {
+	return encodeMarlin(compressor, src, dst, unrepresentedSymbols);
+}
+
+template<typename TSource, typename MarlinIdx>
+MARLIN_TARGET_BMI2
+ssize_t encodeMarlinBMI2(const TMarlinCompress<TSource,MarlinIdx> &compressor, View<const TSource> src, View<uint8_t> dst, std::vector<size_t> &unrepresentedSymbols) {
+	return encodeMarlin(compressor, src, dst, unrepresentedSymbols);
+}
+
+template<typename TSource, typename MarlinIdx>
+MARLIN_TARGET_AVX2
+ssize_t encodeMarlinAVX2(const TMarlinCompress<TSource,MarlinIdx> &compressor, View<const TSource> src, View<uint8_t> dst, std::vector<size_t> &unrepresentedSymbols) {
+	return encodeMarlin(compressor, src, dst, unrepresentedSymbols);
+}
+
+template<typename TSource, typename MarlinIdx>
+MARLIN_TARGET_AVX512
+ssize_t encodeMarlinAVX512(const TMarlinCompress<TSource,MarlinIdx> &compressor, View<const TSource> src, View<uint8_t> dst, std::vector<size_t> &unrepresentedSymbols) {
+	return encodeMarlin(compressor, src, dst, unrepresentedSymbols);
+}
+
+template<typename TSource, typename MarlinIdx>
+auto selectEncodeMarlin() -> typename EncodeKernel<TSource,MarlinIdx>::EncodeFunction {
+
+	for (auto &&kernel : encodeKernels<TSource,MarlinIdx>())
+		if (cpuSupports(kernel.level)) return kernel.encode;
+	return &encodeMarlinScalar<TSource,MarlinIdx>;
+}
+
+// Runs of the most common symbol at least this long are cut out of the block. Even
+// the longest words cover 255 symbols, so such a run costs Marlin a few codewords and
+// its escape only a few bytes.
+constexpr size_t MIN_RUN = 256;
+
+inline size_t varintSize(size_t v) {
+	size_t ret = 1;
+	while (v >> (7*ret)) ret++;
+	return ret;
+}
+
+inline void writeVarint(uint8_t *&out, size_t v) {
+	for (; v >= 0x80; v >>= 7)
+		*out++ = uint8_t(v | 0x80);
+	*out++ = uint8_t(v);
+}
+
+// Appends the start and length of each run of symbol of MIN_RUN symbols or more.
+// Vectors of 16 bytes are compared with symbol at once, so only vectors where a run
+// ends or starts take a look at single symbols. Lengths are cut to multiples of 8 so
+// that the symbols left are still a whole number of words of 8, and at least 8 are left.
+template<typename TSource>
+void findRuns(View<const TSource> src, TSource symbol, std::vector<size_t> &runs) {
+	
+	constexpr size_t VECTOR = 16/sizeof(TSource);
+	TSource pattern[VECTOR];
+	std::fill(pattern, pattern+VECTOR, symbol);
+	const __m128i symbols = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pattern));
+	
+	const size_t n = src.nElements();
+	size_t removed = 0;
+	auto addRun = [&](size_t start, size_t end) {
+		const size_t length = (end-start)/8*8;
+		if (length < MIN_RUN) return;
+		runs.push_back(start);
+		runs.push_back(length);
+		removed += length;
+	};
+	
+	size_t runStart = 0, i = 0;
+	for (; i + VECTOR <= n; i += VECTOR) {
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src.start+i));
+		uint32_t different = ~_mm_movemask_epi8(_mm_cmpeq_epi8(v, symbols)) & 0xFFFF;
+		if (LIKELY(different == 0)) continue;
+		addRun(runStart, i + __builtin_ctz(different)/sizeof(TSource));
+		runStart = i + (31-__builtin_clz(different))/sizeof(TSource) + 1;
+	}
+	for (; i < n; i++) {
+		if (src.start[i] == symbol) continue;
+		addRun(runStart, i);
+		runStart = i+1;
+	}
+	addRun(runStart, n);
+	
+	if (removed == n) runs.back() -= 8;
+}
+
+}
+
+template<typename TSource, typename MarlinIdx>
+std::vector<EncodeKernel<TSource,MarlinIdx>> marlin::encodeKernels() {
+
+	return {
+		{ "avx512", CpuLevel::AVX512, &encodeMarlinAVX512<TSource,MarlinIdx> },
+		{ "avx2",   CpuLevel::AVX2,   &encodeMarlinAVX2<TSource,MarlinIdx>   },
+		{ "bmi2",   CpuLevel::BMI2,   &encodeMarlinBMI2<TSource,MarlinIdx>   },
+		{ "scalar", CpuLevel::Scalar, &encodeMarlinScalar<TSource,MarlinIdx> },
+	};
 }
 
 template<typename TSource, typename MarlinIdx>
 auto TMarlinCompress<TSource,MarlinIdx>::buildCompressorTableInit(const TMarlinDictionary<TSource,MarlinIdx> &dictionary) const -> std::unique_ptr<std::vector<CompressorTableIdx>> {
 
+	BuildTimer timer(BuildPhase::CompressorTable);
 	auto ret = std::make_unique<std::vector<CompressorTableIdx>>();
 		
 	for (size_t ms=0; ms<dictionary.marlinAlphabet.size(); ms++) {		
@@ -240,6 +473,7 @@ auto TMarlinCompress<TSource,MarlinIdx>::buildCompressorTableInit(const TMarlinD
 template<typename TSource, typename MarlinIdx>
 auto TMarlinCompress<TSource,MarlinIdx>::buildCompressorTable(const TMarlinDictionary<TSource,MarlinIdx> &dictionary) const -> std::unique_ptr<std::vector<CompressorTableIdx>> {
 
+	BuildTimer timer(BuildPhase::CompressorTable);
 	auto ret = std::make_unique<std::vector<CompressorTableIdx>>();
 	JumpTable jump(K, O, unrepresentedSymbolToken+1);
 	jump.initTable(*ret);
@@ -253,34 +487,70 @@ auto TMarlinCompress<TSource,MarlinIdx>::buildCompressorTable(const TMarlinDicti
 		for (size_t i=k*ChapterSize; i<(k+1)*ChapterSize; i++)
 			positions[k][dictionary.words[i]] = i;
 			
-	// Link each possible word to its continuation
+	// Link each possible word to its continuation. Every prefix of a word is also a word,
+	// so linking each word to its parent covers the whole chain up to the root.
 	for (size_t k=0; k<NumChapters; k++) {
+		Word parent;
 		for (size_t i=k*ChapterSize; i<(k+1)*ChapterSize; i++) {
-			auto word = dictionary.words[i];
-			size_t wordIdx = i;
-			while (word.size() > 1) {
-				TSource lastSymbol = word.back();						
-				word.pop_back();
-				if (not positions[k].count(word)) throw(std::runtime_error("This word has no parent. SHOULD NEVER HAPPEN!!!"));
-				size_t parentIdx = positions[k][word];
-				jump(&ret->front(), parentIdx, lastSymbol) = wordIdx;
-				wordIdx = parentIdx;
-			}
+			const Word &word = dictionary.words[i];
+			if (word.size() <= 1) continue;
+			parent.assign(word.begin(), word.end()-1);
+			auto it = positions[k].find(parent);
+			if (it == positions[k].end()) throw(std::runtime_error("This word has no parent. SHOULD NEVER HAPPEN!!!"));
+			jump(&ret->front(), it->second, word.back()) = i;
 		}
 	}
 				
 	//Link between inner dictionaries
+	std::vector<std::vector<size_t>> firstWord(NumChapters);
+	for (size_t k=0; k<NumChapters; k++)
+		for (size_t j=0; j<dictionary.marlinAlphabet.size(); j++)
+			firstWord[k].push_back(positions[k][Word(1,j)]);
+
 	for (size_t k=0; k<NumChapters; k++)
 		for (size_t i=k*ChapterSize; i<(k+1)*ChapterSize; i++)
 			for (size_t j=0; j<dictionary.marlinAlphabet.size(); j++)
 				if (jump(&ret->front(),i,j) == CompressorTableIdx(-1)) // words that are not parent of anyone else.
-					jump(&ret->front(),i,j) = positions[i%NumChapters][Word(1,j)] + FLAG_NEXT_WORD;
+					jump(&ret->front(),i,j) = firstWord[i%NumChapters][j] + FLAG_NEXT_WORD;
 										
 	return ret;
 }
 
 template<typename TSource, typename MarlinIdx>
 ssize_t TMarlinCompress<TSource,MarlinIdx>::compress(View<const TSource> src, View<uint8_t> dst) const {
+
+	MarlinWorkspace workspace;
+	return compressBlock(src, dst, workspace);
+}
+
+template<typename TSource, typename MarlinIdx>
+ssize_t TMarlinCompress<TSource,MarlinIdx>::compress(View<const TSource> src, View<uint8_t> dst, MarlinWorkspace &workspace) const {
+
+	workspace.unrepresentedSymbols.clear();
+	return compressBlock(src, dst, workspace);
+}
+
+template<typename TSource, typename MarlinIdx>
+ssize_t TMarlinCompress<TSource,MarlinIdx>::compress(View<const TSource> src, View<uint8_t> dst, MarlinWorkspace &workspace, const BlockStats<TSource> &stats) const {
+
+	workspace.unrepresentedSymbols.clear();
+	return compressBlock(src, dst, workspace, &stats);
+}
+
+// workspace.unrepresentedSymbols must be empty on entry. stats, if given, are those of src.
+//
+// Block layout: a varint with twice the number of unrepresented symbols, plus one if
+// there are runs, the runs, the Marlin stream, the unrepresented symbols (if any) and
+// the residuals. Unrepresented symbols are stored raw, followed by the distance of each
+// of their positions to the previous one, packed in as many bits as the largest
+// distance needs, and that number of bits in a byte.
+//
+// Runs of at least MIN_RUN runSymbol are cut out of the block before it is encoded,
+// and everything after them describes the symbols left. They are stored as a varint
+// with their number, then for each run a varint with the symbols since the end of the
+// previous one and a varint with its length divided by 8.
+template<typename TSource, typename MarlinIdx>
+ssize_t TMarlinCompress<TSource,MarlinIdx>::compressBlock(View<const TSource> src, View<uint8_t> dst, MarlinWorkspace &workspace, const BlockStats<TSource> *stats) const {
 	// Assertions
 	if (dst.nBytes() < src.nBytes()) return -1; //TODO: Real error codes
 	
@@ -288,85 +558,182 @@ ssize_t TMarlinCompress<TSource,MarlinIdx>::compress(View<const TSource> src, Vi
 	if (src.nElements()==0) return 0;
 
 	// Special case: the entire block is made of one symbol!
-	{
-		size_t count = 0;
-		for (size_t i=0; i<src.nElements() and src.start[i] == src.start[0]; i++)
-			count++;
-		
-		if (count==src.nElements()) {
-			reinterpret_cast<TSource *>(dst.start)[0] = src.start[0];
-			return sizeof(TSource);
-		}
+	if (stats ? stats->isSingleSymbol() : isSingleSymbol(src)) {
+		memcpy(dst.start, src.start, sizeof(TSource));
+		return sizeof(TSource);
 	}
 
 	// Special case: if srcSize is not multiple of 8, we force it to be.
 	size_t padding = 0;
-	while (src.nBytes() % 8 != 0) {
-		*reinterpret_cast<TSource *&>(dst.start)++ = *src.start++;			
+	while (src.nElements() % 8 != 0) {
+		memcpy(dst.start, src.start++, sizeof(TSource));
+		dst.start += sizeof(TSource);
 		padding += sizeof(TSource);
 	}
+	if (src.nElements()==0) return padding;
+
+	// From here on src holds the symbols left once the runs are cut out.
+	const View<const TSource> block = src;
+	std::vector<size_t> &runs = workspace.runs;
+	runs.clear();
+	if (stats == nullptr or stats->histogram[runSymbol] >= MIN_RUN)
+		findRuns(src, runSymbol, runs);
+	
+	size_t runsSize = 0;
+	if (not runs.empty()) {
+		size_t previousEnd = 0, removed = 0;
+		runsSize = varintSize(runs.size()/2);
+		for (size_t r=0; r<runs.size(); r+=2) {
+			runsSize += varintSize(runs[r]-previousEnd) + varintSize(runs[r+1]/8);
+			previousEnd = runs[r] + runs[r+1];
+			removed += runs[r+1];
+		}
+		
+		workspace.packed.resize((block.nElements()-removed)*sizeof(TSource));
+		TSource *out = reinterpret_cast<TSource *>(workspace.packed.data());
+		const TSource *in = block.start;
+		for (size_t r=0; r<runs.size(); r+=2) {
+			out = std::copy(in, block.start+runs[r], out);
+			in = block.start+runs[r]+runs[r+1];
+		}
+		out = std::copy(in, block.end, out);
+		src = marlin::make_view<const TSource>(reinterpret_cast<const TSource *>(workspace.packed.data()), out);
+	}
 
+	std::vector<size_t> &unrepresentedSymbols = workspace.unrepresentedSymbols;
 	const size_t srcElementCount = src.nElements();
 
 	size_t residualSize = srcElementCount*shift/8;
 
 
-	std::vector<size_t> unrepresentedSymbols;		
-	// This part, we encode the number of unrepresented symbols in a byte.
-	// We are optimistic and we hope that no unrepresented symbols are required.
+	// This part, we encode the number of unrepresented symbols.
+	// We are optimistic and we hope that it fits in a byte, otherwise the streams move.
 	*dst.start = 0;
 	
-	// Valid portion available to encode the marlin message.
-	View<uint8_t> marlinDst = marlin::make_view(dst.start+1,dst.end-residualSize);
-	ssize_t marlinSize;
-	if (false) {
-		//marlinSize = compressMarlinReference(src, marlinDst, unrepresentedSymbols);
-	} else if (K==8) {
-		marlinSize = compressMarlin8(*this, src, marlinDst, unrepresentedSymbols);
-	} else {
-		marlinSize = compressMarlinFast(*this, src, marlinDst, unrepresentedSymbols);
-	}
-
-	size_t unrepresentedSize = unrepresentedSymbols.size() * ( sizeof(TSource) + (
-		srcElementCount < 0x100 ? sizeof(uint8_t) :
-		srcElementCount < 0x10000 ? sizeof(uint16_t) :
-		srcElementCount < 0x100000000ULL ? sizeof(uint32_t) :sizeof(uint64_t)
-		));
-	
+	// Valid portion available to encode the marlin message, after room for the runs.
+	View<uint8_t> marlinDst = marlin::make_view(dst.start+1+runsSize,dst.end-residualSize);
+	static const auto encodeMarlin = selectEncodeMarlin<TSource,MarlinIdx>();
+	ssize_t marlinSize = encodeMarlin(*this, src, marlinDst, unrepresentedSymbols);
+
+	// The encoder finds the positions in order.
+	const size_t nUnrepresented = unrepresentedSymbols.size();
+	size_t maxDistance = 0;
+	for (size_t i=1; i<nUnrepresented; i++)
+		maxDistance = std::max(maxDistance, unrepresentedSymbols[i]-unrepresentedSymbols[i-1]);
+	if (nUnrepresented) maxDistance = std::max(maxDistance, unrepresentedSymbols[0]);
+	const size_t distanceBits = maxDistance ? 64-__builtin_clzll(maxDistance) : 0;
+
+	const size_t count = 2*nUnrepresented + (runs.empty() ? 0 : 1);
+	const size_t countSize = varintSize(count);
+	size_t unrepresentedSize = nUnrepresented ? 
+		nUnrepresented*sizeof(TSource) + (nUnrepresented*distanceBits+7)/8 + 1 : 0;
 	
-	//if (unrepresentedSize) printf("%d \n", unrepresentedSize);
-	// If not worth encoding, we store raw.
+	// If not worth encoding, we store raw. A block of the raw size would be taken as raw,
+	// and one of a single symbol size as a single symbol block.
+	const size_t encodedSize = countSize + runsSize + marlinSize + unrepresentedSize + residualSize;
 	if (marlinSize < 0 	// If the encoded size is negative means that Marlin could not provide any meaningful compression, and the whole stream will be copied.
-		or unrepresentedSymbols.size() > 255 
-		or 1 + marlinSize + unrepresentedSize + residualSize > src.nBytes()) {
+		or encodedSize >= block.nBytes() or encodedSize <= sizeof(TSource)) {
 
-		memcpy(dst.start,src.start,src.nBytes());
-		return padding + src.nBytes();
+		memcpy(dst.start,block.start,block.nBytes());
+		return padding + block.nBytes();
 	}
 	
-	
-	*dst.start++ = unrepresentedSymbols.size();
+	if (countSize > 1)
+		memmove(dst.start+countSize+runsSize, dst.start+1+runsSize, marlinSize);
+	writeVarint(dst.start, count);
+	if (not runs.empty()) {
+		size_t previousEnd = 0;
+		writeVarint(dst.start, runs.size()/2);
+		for (size_t r=0; r<runs.size(); r+=2) {
+			writeVarint(dst.start, runs[r]-previousEnd);
+			writeVarint(dst.start, runs[r+1]/8);
+			previousEnd = runs[r] + runs[r+1];
+		}
+	}
 	dst.start += marlinSize;
 	
-	
 	// Encode unrepresented symbols
-	for (auto &s : unrepresentedSymbols) {
-		if (src.nElements() < 0x100) {
-			*reinterpret_cast<uint8_t *&>(dst.start)++ = s;	
-		} else if (src.nElements() < 0x10000) {
-			*reinterpret_cast<uint16_t *&>(dst.start)++ = s;	
-		} else if (src.nElements() < 0x100000000ULL) {
-			*reinterpret_cast<uint32_t *&>(dst.start)++ = s;	
-		} else {
-			*reinterpret_cast<uint64_t *&>(dst.start)++ = s;	
+	if (nUnrepresented) {
+		for (auto &s : unrepresentedSymbols) {
+			memcpy(dst.start, &src.start[s], sizeof(TSource));
+			dst.start += sizeof(TSource);
+		}
+		
+		uint64_t bits = 0;
+		size_t nBits = 0, previous = 0;
+		for (auto &s : unrepresentedSymbols) {
+			bits |= uint64_t(s-previous) << nBits;
+			nBits += distanceBits;
+			previous = s;
+			for (; nBits >= 8; nBits -= 8, bits >>= 8)
+				*dst.start++ = uint8_t(bits);
 		}
-		*reinterpret_cast<TSource *&>(dst.start)++ = src.start[s];	
+		if (nBits) *dst.start++ = uint8_t(bits);
+		*dst.start++ = uint8_t(distanceBits);
 	}
 	
 	// Encode residuals
 	shift8(*this, src, dst);
 	
-	return padding + 1 + marlinSize + unrepresentedSize + residualSize; 
+	return padding + countSize + runsSize + marlinSize + unrepresentedSize + residualSize; 
+}
+
+// Chunked frame layout (all fields little endian uint32_t):
+//   chunkSize (in source symbols), nChunks, compressedSize[nChunks], followed by the chunk payloads.
+// Each payload is a regular Marlin block as produced by compress.
+template<typename TSource, typename MarlinIdx>
+size_t TMarlinCompress<TSource,MarlinIdx>::parallelBound(size_t nElements, size_t chunkSize) {
+
+	if (chunkSize == 0) chunkSize = DEFAULT_CHUNK_SIZE;
+	size_t nChunks = (nElements + chunkSize - 1) / chunkSize;
+	return (2 + nChunks) * sizeof(uint32_t) + nElements * sizeof(TSource);
+}
+
+template<typename TSource, typename MarlinIdx>
+ssize_t TMarlinCompress<TSource,MarlinIdx>::compressParallel(View<const TSource> src, View<uint8_t> dst, size_t chunkSize, size_t nThreads) const {
+
+	if (chunkSize == 0) chunkSize = DEFAULT_CHUNK_SIZE;
+	if (chunkSize > 0xFFFFFFFFULL) return -1;
+	if (dst.nBytes() < parallelBound(src.nElements(), chunkSize)) return -1;
+
+	const size_t nChunks = (src.nElements() + chunkSize - 1) / chunkSize;
+	if (nChunks > 0xFFFFFFFFULL) return -1;
+
+	storeLE32(dst.start, chunkSize);
+	storeLE32(dst.start + sizeof(uint32_t), nChunks);
+	uint8_t *chunkSizes = dst.start + 2*sizeof(uint32_t);
+	uint8_t *payload = chunkSizes + nChunks*sizeof(uint32_t);
+
+	// Every chunk is first compressed in place, in a slot as large as its source,
+	// and the slots are compacted afterwards.
+	std::atomic<bool> failed(false);
+	parallelFor(nChunks, nThreads, [&](size_t i) {
+		
+		size_t sz = std::min(chunkSize, src.nElements() - i*chunkSize);
+		auto in  = marlin::make_view(src.start + i*chunkSize, src.start + i*chunkSize + sz);
+		auto out = marlin::make_view(payload + i*chunkSize*sizeof(TSource), payload + (i*chunkSize+sz)*sizeof(TSource));
+		
+		ssize_t r = compress(in, out);
+		if (r < 0) failed = true;
+		storeLE32(chunkSizes + i*sizeof(uint32_t), r);
+	});
+	if (failed) return -1;
+
+	uint8_t *out = payload;
+	for (size_t i=0; i<nChunks; i++) {
+		const uint32_t sz = loadLE32(chunkSizes + i*sizeof(uint32_t));
+		memmove(out, payload + i*chunkSize*sizeof(TSource), sz);
+		out += sz;
+	}
+	return out - dst.start;
+}
+
+template<typename TSource, typename MarlinIdx>
+TSource TMarlinCompress<TSource,MarlinIdx>::buildRunSymbol() const {
+	
+	for (size_t s=0; s<source2marlin.size(); s++)
+		if (source2marlin[s] == 0) return TSource(s<<shift);
+	return 0;
 }
 
 template<typename TSource, typename MarlinIdx>
@@ -386,6 +753,8 @@ std::array<MarlinIdx, 1U<<(sizeof(TSource)*8)> TMarlinCompress<TSource,MarlinIdx
 // Explicit Instantiations
 #include "instantiations.h"
 INSTANTIATE(TMarlinCompress)	
+template std::vector<EncodeKernel<uint8_t,uint8_t>> marlin::encodeKernels<uint8_t,uint8_t>();
+template std::vector<EncodeKernel<uint16_t,uint8_t>> marlin::encodeKernels<uint16_t,uint8_t>();
 
 //INSTANTIATE_MEMBER(buildCompressorTableInit() const -> std::unique_ptr<std::vector<CompressorTableIdx>>)	
 //INSTANTIATE_MEMBER(buildCompressorTable() const -> std::unique_ptr<std::vector<CompressorTableIdx>>)	
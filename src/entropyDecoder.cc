@@ -30,316 +30,319 @@ SOFTWARE.
 
 #include <cstring>
 #include <algorithm>
+#include <array>
 #include <cassert>
 #include <immintrin.h>
 
+#include "buildTiming.hpp"
+#include "dispatch.hpp"
+#include "frame.hpp"
+#include "kernels.hpp"
+#include "parallel.hpp"
+#include "residuals.hpp"
 
 using namespace marlin;
 
 namespace {
 
 template<typename TSource, typename MarlinIdx>
-__attribute__ ((target ("bmi2")))
 ssize_t shift8(const TMarlinDecompress<TSource,MarlinIdx> &decompressor, View<const uint8_t> src, View<TSource> dst) {
 	
 	// Decode residuals
-	uint64_t mask=0;
-	for (size_t i=0; i<8; i++)
-		mask |= ((1ULL<<decompressor.shift)-1)<<(8ULL*i);
+	unpackResiduals(src.start, dst.start, dst.nElements(), decompressor.shift);
 	
-	const uint8_t *i8 = reinterpret_cast<const uint8_t *>(src.start);
-	uint64_t *o64    = reinterpret_cast<uint64_t *>(dst.start);
-	uint64_t *o64end = reinterpret_cast<uint64_t *>(dst.end);
+	return dst.nElements();
+}
 
-	while (o64 != o64end) {
-		*o64++ |= _pdep_u64(*reinterpret_cast<const uint64_t *>(i8), mask);
-		i8 += decompressor.shift;
-	}
-	
-	return reinterpret_cast<TSource *>(o64) - dst.start;
+// Decoding state of a Marlin stream, shared by the step and tail helpers of the KK decoders.
+template<typename TSource>
+struct StreamState {
+	const uint8_t *i8, *end;
+	      TSource *o8, *oend;
+	uint64_t value;
+
+	StreamState(View<const uint8_t> src, View<TSource> dst) :
+		i8(src.start), end(src.end), o8(dst.start), oend(dst.end), value(0) {}
+};
+
+// The fast decoders read a short decoder table entry (maxWordSize symbols followed by
+// the size of the word) as a single integer of maxWordSize+1 symbols.
+template<size_t Bytes> struct Entry;
+template<> struct Entry< 4> { typedef uint32_t type; };
+template<> struct Entry< 8> { typedef uint64_t type; };
+
+// Entries and output words are accessed with memcpy, as they are only aligned to TSource.
+template<typename T, typename TSource>
+MARLIN_INLINE T loadEntry(const TSource *D, size_t idx) {
+
+	T v;
+	memcpy(&v, reinterpret_cast<const uint8_t *>(D) + idx*sizeof(T), sizeof(T));
+	return v;
 }
 
-template<typename T, typename TSource, typename MarlinIdx>
-size_t decompress8_skip(
-	const TMarlinDecompress<TSource,MarlinIdx> &decompressor, 
-	View<const uint8_t> src, 
-	View<TSource> dst) {
-	
-	const uint8_t *i8    = src.start;
-		  TSource *o8    = dst.start;
+// Size of the word held in entry v, stored in its last symbol.
+template<typename T, typename TSource>
+MARLIN_INLINE size_t entrySize(T v) {
 
-	const uint32_t overlappingMask = (1<<(8+decompressor.O))-1;
-	uint64_t value = 0;
+	return size_t(v >> (8*(sizeof(T)-sizeof(TSource))));
+}
 
-	auto D = decompressor.decompressorTablePointer;
+// Masks out the size of the word.
+template<typename T, typename TSource>
+MARLIN_INLINE T entrySizeMask() {
 
-	while (i8<src.end-10) {
-		
-		uint32_t v32 = (*(const uint32_t *)i8);
-		i8 += sizeof(uint32_t);
-		value = (value<<32) +  __builtin_bswap32(v32);
-		{
-			T v = ((const T *)D)[(value>>24) & overlappingMask];
-			*((T *)o8) = v;
-			o8 += v >> ((sizeof(T)-1)*8);
-			
-		}
+	return T(-1) >> (8*sizeof(TSource));
+}
 
-		{
-			T v = ((const T *)D)[(value>>16) & overlappingMask];
-			*((T *)o8) = v;
-			o8 += v >> ((sizeof(T)-1)*8);
-		}
+// Words longer than W symbols continue with a run of the most common symbol (see
+// buildTree), which is not in the decoder table. The fast decoders write the first
+// COVERED symbols of every word along with a vector of that symbol, so only longer
+// words need more stores.
+template<typename TSource>
+struct Run {
 
-		{
-			T v = ((const T *)D)[(value>>8) & overlappingMask];
-			*((T *)o8) = v;
-			o8 += v >> ((sizeof(T)-1)*8);
+	constexpr static const size_t RUN = 16/sizeof(TSource);
+	const __m128i v;
+
+	Run(TSource mostCommonSymbol) : v(sizeof(TSource) == 1 ?
+		_mm_set1_epi8(char(mostCommonSymbol)) : _mm_set1_epi16(short(mostCommonSymbol))) {}
+
+	// Moves o8 past a word of sz symbols, writing what is left of its run. That touches
+	// up to RUN symbols past limit, where the run stops; only a corrupt stream gets there.
+	template<size_t COVERED>
+	MARLIN_INLINE void finish(TSource *&o8, size_t sz, const TSource *limit) const {
+
+		if (__builtin_expect(sz <= COVERED, 1)) {
+			o8 += sz;
+			return;
 		}
+		TSource *end = std::max(o8+COVERED, std::min(o8+sz, const_cast<TSource *>(limit)));
+		for (TSource *o = o8+COVERED; o < end; o += RUN)
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(o), v);
+		o8 = end;
+	}
+};
 
-		{
-			T v = ((const T *)D)[value & overlappingMask];
-			*((T *)o8) = v;
-			o8 += v >> ((sizeof(T)-1)*8);
+// Same for the last words of a stream, where the run stops at the end of the output.
+template<size_t W, typename TSource>
+MARLIN_INLINE void emitTailRun(TSource *o8, size_t sz, size_t room, TSource mostCommonSymbol) {
+
+	if (sz > W and room > W)
+		std::fill(o8+W, o8+std::min(sz, room), mostCommonSymbol);
+}
+
+// Copies the words of a decoder table whose entries hold W symbols and the size of the
+// word. Unless the dictionary is in skip mode (where all words fit in W symbols) the
+// size is replaced by the most common symbol on the way, and longer words get their run.
+// Entries of 4 or 8 bytes are moved as one integer, which in non-skip mode is widened
+// to a vector whose upper symbols start the run.
+template<typename TSource, size_t W_, bool Skip, bool Packed = ((W_+1)*sizeof(TSource) <= 8)>
+struct WordCopy {
+
+	constexpr static const size_t W = W_;
+	constexpr static const bool SKIP = Skip;
+	constexpr static const size_t STRIDE = Skip ? W+1 : Run<TSource>::RUN;
+	typedef typename Entry<(W+1)*sizeof(TSource)>::type T;
+	const TSource mostCommonSymbol;
+	const Run<TSource> run;
+	const __m128i clearSize, runStart;
+
+	WordCopy(TSource mostCommonSymbol_) :
+		mostCommonSymbol(mostCommonSymbol_),
+		run(mostCommonSymbol_),
+		clearSize(_mm_cvtsi64_si128((long long)(entrySizeMask<T,TSource>()))),
+		runStart(_mm_andnot_si128(clearSize, run.v)) {}
+
+	// Touches STRIDE symbols of output (see Run for longer words), so the caller must
+	// ensure there is room for them.
+	MARLIN_INLINE void emit(TSource *&o8, const TSource *limit, const TSource *D, size_t wordIdx) const {
+
+		T v = loadEntry<T>(D, wordIdx);
+		if (Skip) {
+			memcpy(o8, &v, sizeof(T));
+			o8 += entrySize<T,TSource>(v);
+		} else {
+			__m128i w = _mm_or_si128(_mm_and_si128(_mm_cvtsi64_si128((long long)(v)), clearSize), runStart);
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(o8), w);
+			run.template finish<STRIDE>(o8, entrySize<T,TSource>(v), limit);
 		}
 	}
-	
-	while (i8<src.end) {
-		value = (value<<8) + *i8++;
-		{
-			T v = ((const T *)D)[value & overlappingMask];
-			size_t sz = v >> ((sizeof(T)-1)*8);
-			memcpy(o8, &v, sz);
-//			*((T *)o8) = v;
-			
+
+	// Writes at most room symbols.
+	MARLIN_INLINE void emitTail(TSource *&o8, size_t room, const TSource *D, size_t wordIdx) const {
+
+		T v = loadEntry<T>(D, wordIdx);
+		size_t sz = entrySize<T,TSource>(v);
+		memcpy(o8, &v, std::min(std::min(sz, size_t(W)), room)*sizeof(TSource));
+		if (not Skip) emitTailRun<W>(o8, sz, room, mostCommonSymbol);
+		o8 += sz;
+	}
+};
+
+// Longer entries span a whole number of 16 byte vectors, which are moved with SSE2 loads
+// and stores (part of x86-64, so also available to the baseline kernels). The size is
+// read on its own. In non-skip mode it is overwritten, and a vector of the run follows.
+template<typename TSource, size_t W_, bool Skip>
+struct WordCopy<TSource,W_,Skip,false> {
+
+	constexpr static const size_t W = W_;
+	constexpr static const bool SKIP = Skip;
+	constexpr static const size_t STRIDE = Skip ? W+1 : W+1+Run<TSource>::RUN;
+	constexpr static const size_t VECTORS = (W+1)*sizeof(TSource)/16;
+	static_assert((W+1)*sizeof(TSource) == VECTORS*16, "entries must be a multiple of 16 bytes");
+	const TSource mostCommonSymbol;
+	const Run<TSource> run;
+
+	WordCopy(TSource mostCommonSymbol_) : mostCommonSymbol(mostCommonSymbol_), run(mostCommonSymbol_) {}
+
+	MARLIN_INLINE void emit(TSource *&o8, const TSource *limit, const TSource *D, size_t wordIdx) const {
+
+		const TSource *entry = &D[wordIdx*(W+1)];
+		size_t sz = entry[W];
+		const __m128i *in = reinterpret_cast<const __m128i *>(entry);
+		__m128i *out = reinterpret_cast<__m128i *>(o8);
+		for (size_t i=0; i<VECTORS; i++)
+			_mm_storeu_si128(out+i, _mm_loadu_si128(in+i));
+		if (Skip) {
 			o8 += sz;
+		} else {
+			o8[W] = mostCommonSymbol;
+			_mm_storeu_si128(out+VECTORS, run.v);
+			run.template finish<STRIDE>(o8, sz, limit);
 		}
-	}				
-	// if (endMarlin-i8 != 0) std::cerr << " {" << endMarlin-i8 << "} "; // SOLVED! PROBLEM IN THE CODE
-	// if (o8end-o8 != 0) std::cerr << " [" << o8end-o8 << "] "; // SOLVED! PROBLEM IN THE CODE
+	}
 
-	return dst.nElements();
+	MARLIN_INLINE void emitTail(TSource *&o8, size_t room, const TSource *D, size_t wordIdx) const {
+
+		const TSource *entry = &D[wordIdx*(W+1)];
+		size_t sz = entry[W];
+		memcpy(o8, entry, std::min(std::min(sz, size_t(W)), room)*sizeof(TSource));
+		if (not Skip) emitTailRun<W>(o8, sz, room, mostCommonSymbol);
+		o8 += sz;
+	}
+};
+
+// KK<8 reads KK bytes and decodes 8 words per step, otherwise it reads KK/2 bytes and decodes 4.
+template<size_t KK>
+struct StepKK {
+	constexpr static const size_t INCREMENT = KK<8?KK:KK/2;
+	constexpr static const size_t INCREMENTSHIFT = INCREMENT*8;
+	constexpr static const size_t WORDS = KK<8?8:4;
+};
+
+// Room needed around a step. A step writes at most OUTPUT symbols, as long as no run of a
+// long word goes past LIMIT symbols before the end of the output (see Run).
+// In non-skip mode, the input left after a step holds enough words that in a valid
+// stream no run gets there, so the words of the step are always decoded in full.
+template<size_t KK, typename Copy>
+struct RoomKK {
+	constexpr static const size_t WORDS = StepKK<KK>::WORDS;
+	constexpr static const size_t OUTPUT = WORDS*Copy::STRIDE;
+	constexpr static const size_t LIMIT = (WORDS-1)*Copy::STRIDE;
+	constexpr static const size_t INPUT = StepKK<KK>::INCREMENT + 20 + (Copy::SKIP ? 0 : (LIMIT+2)*KK/8+1);
+};
+
+template<size_t KK, typename Copy, typename TSource>
+MARLIN_INLINE bool hasRoomKK(const StreamState<TSource> &s) {
+
+	return s.end-s.i8 > ptrdiff_t(RoomKK<KK,Copy>::INPUT) and
+		s.oend-s.o8 >= ptrdiff_t(RoomKK<KK,Copy>::OUTPUT);
 }
 
-template<typename T, size_t KK, typename TSource, typename MarlinIdx>
-size_t decompressKK(
-	const TMarlinDecompress<TSource,MarlinIdx> &decompressor, 
-	View<const uint8_t> src, 
-	View<TSource> dst) {
-	
-	const uint8_t *i8    = src.start;
-		  TSource *o8    = dst.start;
+// Number of steps that can run back to back without checking hasRoomKK. The runs of long
+// words make the output of a step unbounded, so in non-skip mode every step is checked.
+template<size_t KK, typename Copy, typename TSource>
+MARLIN_INLINE size_t safeStepsKK(const StreamState<TSource> &s) {
 
-	const uint64_t overlappingMask = (1<<(decompressor.K+decompressor.O))-1;
-	const T clearSizeMask = T(-1)>>8;
-	const T clearSizeOverlay = T(decompressor.marlinMostCommonSymbol) << ((sizeof(T)-1)*8);
-	uint64_t value = 0;
+	if (not Copy::SKIP) return hasRoomKK<KK,Copy>(s) ? 1 : 0;
 
-	auto D = decompressor.decompressorTablePointer;
+	ptrdiff_t in = s.end-s.i8-ptrdiff_t(RoomKK<KK,Copy>::INPUT);
+	return std::min(size_t(std::max(in, ptrdiff_t(0)))/StepKK<KK>::INCREMENT,
+		size_t(std::max(s.oend-s.o8, ptrdiff_t(0)))/RoomKK<KK,Copy>::OUTPUT);
+}
 
-	constexpr size_t INCREMENT = KK<8?KK:KK/2;
-	constexpr size_t INCREMENTSHIFT = INCREMENT*8;
-
-	while (i8<src.end-INCREMENT-20) {
-
-		uint64_t vRead = 
-			(INCREMENT<=4?
-				__builtin_bswap32(*(const uint32_t *)i8):
-				__builtin_bswap64(*(const uint64_t *)i8));
-		i8 += INCREMENT;
-		value = (value<<INCREMENTSHIFT) +  (vRead>>((INCREMENT<=4?32:64)-INCREMENTSHIFT));
-
-		if (KK<8) {
-			{
-				T v = ((const T *)D)[(value>>(7*(KK%8))) & overlappingMask];
-				*((T *)o8) = (v & clearSizeMask) + clearSizeOverlay;
-				o8 += v >> ((sizeof(T)-1)*8);
-				
-			}
-
-			{
-				T v = ((const T *)D)[(value>>(6*(KK%8))) & overlappingMask];
-				*((T *)o8) = (v & clearSizeMask) + clearSizeOverlay;
-				o8 += v >> ((sizeof(T)-1)*8);
-			}
-
-			{
-				T v = ((const T *)D)[(value>>(5*(KK%8))) & overlappingMask];
-				*((T *)o8) = (v & clearSizeMask) + clearSizeOverlay;
-				o8 += v >> ((sizeof(T)-1)*8);
-			}
-
-			{
-				T v = ((const T *)D)[(value>>(4*(KK%8))) & overlappingMask];
-				*((T *)o8) = (v & clearSizeMask) + clearSizeOverlay;
-				o8 += v >> ((sizeof(T)-1)*8);
-			}
-		}
+template<size_t KK, size_t O, typename Copy, typename TSource>
+MARLIN_INLINE void stepKK(const Copy &copy, const TSource *D, StreamState<TSource> &s) {
 
-		{
-			{
-				T v = ((const T *)D)[(value>>(3*KK)) & overlappingMask];
-				*((T *)o8) = (v & clearSizeMask) + clearSizeOverlay;
-				o8 += v >> ((sizeof(T)-1)*8);
-				
-			}
-
-			{
-				T v = ((const T *)D)[(value>>(2*KK)) & overlappingMask];
-				*((T *)o8) = (v & clearSizeMask) + clearSizeOverlay;
-				o8 += v >> ((sizeof(T)-1)*8);
-			}
-
-			{
-				T v = ((const T *)D)[(value>>(1*KK)) & overlappingMask];
-				*((T *)o8) = (v & clearSizeMask) + clearSizeOverlay;
-				o8 += v >> ((sizeof(T)-1)*8);
-			}
-
-			{
-				T v = ((const T *)D)[(value>>(0*KK)) & overlappingMask];
-				*((T *)o8) = (v & clearSizeMask) + clearSizeOverlay;
-				o8 += v >> ((sizeof(T)-1)*8);
-			}
-		}
+	constexpr size_t INCREMENT = StepKK<KK>::INCREMENT;
+	constexpr size_t INCREMENTSHIFT = StepKK<KK>::INCREMENTSHIFT;
+	constexpr uint64_t overlappingMask = (1ULL<<(KK+O))-1;
+
+	// The input is read big endian, and is not aligned.
+	uint64_t vRead;
+	if (INCREMENT<=4) {
+		uint32_t v32;
+		memcpy(&v32, s.i8, sizeof(v32));
+		vRead = __builtin_bswap32(v32);
+	} else {
+		memcpy(&vRead, s.i8, sizeof(vRead));
+		vRead = __builtin_bswap64(vRead);
 	}
-	
-	uint64_t valueBits = decompressor.O;
-	while (i8 < src.end or valueBits>=decompressor.K+decompressor.O) {
-		
-		while (valueBits < decompressor.K+decompressor.O) {
-			value = (value<<8) + uint64_t(*i8++);
-			valueBits += 8;
-		}
-		
-		size_t wordIdx = (value >> (valueBits-(decompressor.K+decompressor.O))) & overlappingMask;
-		
-		valueBits -= decompressor.K;
-					
-		{
-			T v = ((const T *)D)[wordIdx];
-//			*((T *)o8) = (v & clearSizeMask) + clearSizeOverlay;
-//			o8 += v >> ((sizeof(T)-1)*8);
-			
-			
-			size_t sz = v >> ((sizeof(T)-1)*8);
-			
-			T vv = (v & clearSizeMask) + clearSizeOverlay;
-			memcpy(o8, &vv, std::min(sz,sizeof(T)-1));
-//			*((T *)o8) = v;
-			
-			o8 += sz;
-			
-			
-		}
+	s.i8 += INCREMENT;
+	s.value = (s.value<<INCREMENTSHIFT) +  (vRead>>((INCREMENT<=4?32:64)-INCREMENTSHIFT));
+
+	const TSource *limit = s.oend - RoomKK<KK,Copy>::LIMIT;
+
+	if (KK<8) {
+		copy.emit(s.o8, limit, D, (s.value>>(7*(KK%8))) & overlappingMask);
+		copy.emit(s.o8, limit, D, (s.value>>(6*(KK%8))) & overlappingMask);
+		copy.emit(s.o8, limit, D, (s.value>>(5*(KK%8))) & overlappingMask);
+		copy.emit(s.o8, limit, D, (s.value>>(4*(KK%8))) & overlappingMask);
 	}
-	// if (endMarlin-i8 != 0) std::cerr << " {" << endMarlin-i8 << "} "; // SOLVED! PROBLEM IN THE CODE
-	// if (o8end-o8 != 0) std::cerr << " [" << o8end-o8 << "] "; // SOLVED! PROBLEM IN THE CODE
 
-	return dst.nElements();
+	copy.emit(s.o8, limit, D, (s.value>>(3*KK)) & overlappingMask);
+	copy.emit(s.o8, limit, D, (s.value>>(2*KK)) & overlappingMask);
+	copy.emit(s.o8, limit, D, (s.value>>(1*KK)) & overlappingMask);
+	copy.emit(s.o8, limit, D, (s.value>>(0*KK)) & overlappingMask);
 }
 
-template<typename T, size_t TT, size_t KK, typename TSource, typename MarlinIdx>
-__attribute__((optimize("unroll-all-loops")))
-size_t decompressTTKK(
-	const TMarlinDecompress<TSource,MarlinIdx> &decompressor, 
-	View<const uint8_t> src, 
-	View<TSource> dst) {
-	
-	register const uint8_t *i8    = src.start;
-	register      TSource *o8    = dst.start;
-
-	register const uint64_t overlappingMask = (1<<(decompressor.K+decompressor.O))-1;
-	register const T clearSizeMask = T(-1)>>8;
-	register const T clearSizeOverlay = T(decompressor.marlinMostCommonSymbol) << ((sizeof(T)-1)*8);
-	register uint64_t value = 0;
-
-	register auto D = decompressor.decompressorTablePointer;
-
-	constexpr size_t INCREMENT = KK<8?KK:KK/2;
-	constexpr size_t INCREMENTSHIFT = INCREMENT*8;
-
-	while (i8<src.end-INCREMENT-20) {
-
-		uint64_t vRead = 
-			(INCREMENT<=4?
-				__builtin_bswap32(*(const uint32_t *)i8):
-				__builtin_bswap64(*(const uint64_t *)i8));
-		i8 += INCREMENT;
-		value = (value<<INCREMENTSHIFT) +  (vRead>>((INCREMENT<=4?32:64)-INCREMENTSHIFT));
-
-		for (uint64_t j=0; j<4; j++) {
-			const T *vp = &(((const T *)D)[((value>>uint64_t((3-j)*KK)) & overlappingMask)*TT]);
-			//for (size_t i=0; i<TT-1; i++) *((T *&)o8)++ = *vp++;
-			T v = *vp;
-			size_t sz = (v >> ((sizeof(T)-1)*8))-8*(TT-1);
-			*((T *)o8) = (v & clearSizeMask) + clearSizeOverlay;
-			o8 += sz;
-		}
-	}
-	
-	uint64_t valueBits = decompressor.O;
-	while (i8 < src.end or valueBits>=decompressor.K+decompressor.O) {
+template<size_t KK, size_t O, typename Copy, typename TSource>
+MARLIN_INLINE void tailKK(const Copy &copy, const TSource *D, StreamState<TSource> &s) {
+
+	constexpr uint64_t overlappingMask = (1ULL<<(KK+O))-1;
+
+	uint64_t valueBits = O;
+	while (s.i8 < s.end or valueBits>=KK+O) {
 		
-		while (valueBits < decompressor.K+decompressor.O) {
-			value = (value<<8) + uint64_t(*i8++);
+		while (valueBits < KK+O) {
+			s.value = (s.value<<8) + uint64_t(*s.i8++);
 			valueBits += 8;
 		}
 		
-		size_t wordIdx = (value >> (valueBits-(decompressor.K+decompressor.O))) & overlappingMask;
+		size_t wordIdx = (s.value >> (valueBits-(KK+O))) & overlappingMask;
 		
-		valueBits -= decompressor.K;
-					
-		{
-			T v = ((const T *)D)[wordIdx];
-//			*((T *)o8) = (v & clearSizeMask) + clearSizeOverlay;
-//			o8 += v >> ((sizeof(T)-1)*8);
-			
-			
-			size_t sz = v >> ((sizeof(T)-1)*8);
-			
-			T vv = (v & clearSizeMask) + clearSizeOverlay;
-			memcpy(o8, &vv, std::min(sz,sizeof(T)-1));
-//			*((T *)o8) = v;
-			
-			o8 += sz;
-			
-			
-		}
+		valueBits -= KK;
+		
+		copy.emitTail(s.o8, size_t(std::max(s.oend-s.o8, ptrdiff_t(0))), D, wordIdx);
 	}
-	// if (endMarlin-i8 != 0) std::cerr << " {" << endMarlin-i8 << "} "; // SOLVED! PROBLEM IN THE CODE
-	// if (o8end-o8 != 0) std::cerr << " [" << o8end-o8 << "] "; // SOLVED! PROBLEM IN THE CODE
+}
 
+// Everything is passed by value, as output stores could alias it.
+template<size_t KK, size_t O, typename Copy, typename TSource>
+void finishKK(const Copy copy, const TSource *D, StreamState<TSource> s) {
 
-	return dst.nElements();
+	for (size_t n = safeStepsKK<KK,Copy>(s); n; n = safeStepsKK<KK,Copy>(s))
+		while (n--)
+			stepKK<KK,O>(copy, D, s);
+	while (hasRoomKK<KK,Copy>(s))
+		stepKK<KK,O>(copy, D, s);
+	tailKK<KK,O>(copy, D, s);
 }
 
-template<typename T, typename TSource, typename MarlinIdx>
-size_t decompressFast(
+// Decoder for configurations without a specialized kernel: K and O are read at runtime.
+// Skip dictionaries decode the same with the non-skip copy, so it is always used.
+template<size_t W, typename TSource, typename MarlinIdx>
+MARLIN_INLINE void decompressGeneric(
 	const TMarlinDecompress<TSource,MarlinIdx> &decompressor, 
 	View<const uint8_t> src, View<TSource> dst) {
 	
 	auto K = decompressor.K;
 	auto O = decompressor.O;
 	
-	if (K==8 and decompressor.isSkip) return decompress8_skip<T>(decompressor,src,dst);
-	if (K==8) return decompressKK<T,8>(decompressor,src,dst);
-
-	if (K==7) return decompressKK<T,7>(decompressor,src,dst);
-	if (K==6) return decompressKK<T,6>(decompressor,src,dst);
-	if (K==5) return decompressKK<T,5>(decompressor,src,dst);
-	if (K==4) return decompressKK<T,4>(decompressor,src,dst);
-
-	if (K==10) return decompressKK<T,10>(decompressor,src,dst);
-	if (K==12) return decompressKK<T,12>(decompressor,src,dst);
-	if (K==14) return decompressKK<T,14>(decompressor,src,dst);
-	
 	const uint8_t *i8    = src.start;
 		  TSource *o8    = dst.start;
 
-	const T clearSizeMask = T(-1)>>8;
-	const T clearSizeOverlay = T(decompressor.marlinMostCommonSymbol) << ((sizeof(T)-1)*8);
-
+	const WordCopy<TSource,W,false> copy(decompressor.marlinMostCommonSymbol);
 	auto D = decompressor.decompressorTablePointer;
 
 	uint64_t value = 0;
@@ -355,26 +358,12 @@ size_t decompressFast(
 		value = value << K;
 		valueBits -= K;
 
-		{
-			T v = ((const T *)D)[wordIdx];
-//			*((T *)o8) = (v & clearSizeMask) + clearSizeOverlay;
-//			o8 += v >> ((sizeof(T)-1)*8);
-
-			size_t sz = v >> ((sizeof(T)-1)*8);
-			
-			T vv = (v & clearSizeMask) + clearSizeOverlay;
-			memcpy(o8, &vv, std::min(sz,sizeof(T)-1));
-//			*((T *)o8) = v;
-			
-			o8 += sz;
-		}
+		copy.emitTail(o8, size_t(std::max(dst.end-o8, ptrdiff_t(0))), D, wordIdx);
 	}
-	
-	return dst.nElements();
 }
 
 template<typename TSource, typename MarlinIdx>
-size_t decompressSlow(
+MARLIN_INLINE size_t decompressSlow(
 	const TMarlinDecompress<TSource,MarlinIdx> &decompressor, 
 	View<const uint8_t> src, View<TSource> dst) {
 	
@@ -387,9 +376,6 @@ size_t decompressSlow(
 
 	auto D = decompressor.decompressorTablePointer;
 	
-	size_t f = 1;
-	while (size_t(1<<f)<maxWordSize) f++;
-
 	uint64_t value = 0;
 	uint64_t valueBits = O;
 	while (i8 < src.end or valueBits>=K+O) {
@@ -404,51 +390,158 @@ size_t decompressSlow(
 		valueBits -= K;
 
 		{
-			memcpy(o8,&D[wordIdx<<f],maxWordSize); //fails for uint16_t
-			o8 += D[(wordIdx<<f)+maxWordSize];
+			const TSource *word = &D[wordIdx*(maxWordSize+1)];
+			size_t sz = word[maxWordSize];
+			size_t room = size_t(std::max(dst.end-o8, ptrdiff_t(0)));
+			memcpy(o8, word, std::min(maxWordSize, room)*sizeof(TSource));
+			if (sz > maxWordSize and room > maxWordSize)
+				std::fill(o8+maxWordSize, o8+std::min(sz, room), decompressor.marlinMostCommonSymbol);
+			o8 += sz;
 		}
 	}
 	
 	return dst.nElements();
 }
-/*
+
+
 template<typename TSource, typename MarlinIdx>
-size_t decompressSlow(const TMarlinCompress<TSource,MarlinIdx> &decompressor, View<const uint8_t> src, View<TSource> dst) {
-	
-	const uint8_t *i8 = src.start;
-		  TSource *o8 = dst.start;
-	
-	uint64_t value = 0;
-	uint64_t valueBits = O;
-	while (i8 < src.end or valueBits>=K+O) {
-		while (valueBits < K+O) {
-			value += uint64_t(*i8++) << (64-8-valueBits);
-			valueBits += 8;
-		}
-		
-		size_t wordIdx = value >> (64-(K+O));
-		
-		value = value << K;
-		valueBits -= K;
-					
-		for (auto &&c : words[wordIdx])
-			*o8++ = marlinAlphabet[c].sourceSymbol;
+MARLIN_INLINE void decodeMarlin(
+	const TMarlinDecompress<TSource,MarlinIdx> &decompressor,
+	View<const uint8_t> src, View<TSource> dst) {
+
+	switch (decompressor.maxWordSize) {
+	case  3: decompressGeneric< 3>(decompressor, src, dst); break;
+	case  7: decompressGeneric< 7>(decompressor, src, dst); break;
+	case 15: decompressGeneric<15>(decompressor, src, dst); break;
+	case 31: decompressGeneric<31>(decompressor, src, dst); break;
+	case 63: decompressGeneric<63>(decompressor, src, dst); break;
+	default: decompressSlow(decompressor, src, dst);
 	}
-	
-	return dst.nElements();
-}*/
+}
+
+// The same decoder compiled for each instruction set level (see dispatch.hpp).
+template<typename TSource, typename MarlinIdx>
+void decodeMarlinScalar(const TMarlinDecompress<TSource,MarlinIdx> &decompressor, View<const uint8_t> src, View<TSource> dst) {
+	decodeMarlin(decompressor, src, dst);
+}
+
+template<typename TSource, typename MarlinIdx>
+MARLIN_TARGET_BMI2
+void decodeMarlinBMI2(const TMarlinDecompress<TSource,MarlinIdx> &decompressor, View<const uint8_t> src, View<TSource> dst) {
+	decodeMarlin(decompressor, src, dst);
+}
+
+template<typename TSource, typename MarlinIdx>
+MARLIN_TARGET_AVX2
+void decodeMarlinAVX2(const TMarlinDecompress<TSource,MarlinIdx> &decompressor, View<const uint8_t> src, View<TSource> dst) {
+	decodeMarlin(decompressor, src, dst);
+}
+
+template<typename TSource, typename MarlinIdx>
+MARLIN_TARGET_AVX512
+void decodeMarlinAVX512(const TMarlinDecompress<TSource,MarlinIdx> &decompressor, View<const uint8_t> src, View<TSource> dst) {
+	decodeMarlin(decompressor, src, dst);
+}
+
+// The slow decoder whatever maxWordSize is, which decodeMarlin only uses for sizes it has
+// no generic decoder for. Listed in decodeKernels to check the others against.
+template<typename TSource, typename MarlinIdx>
+void decodeSlow(const TMarlinDecompress<TSource,MarlinIdx> &decompressor, View<const uint8_t> src, View<TSource> dst) {
+	decompressSlow(decompressor, src, dst);
+}
+
+// Kernels with K, O and maxWordSize known at compile time, for every configuration
+// that updateConf can produce with K among the sizes stepKK handles and O up to 4.
+// Their shifts and masks are all constants, so unlike the generic decoder they are not
+// compiled per instruction set level: only the baseline is.
+template<typename TSource, typename MarlinIdx, size_t KK, size_t O, size_t W, bool Skip>
+void decodeSpecialized(const TMarlinDecompress<TSource,MarlinIdx> &decompressor, View<const uint8_t> src, View<TSource> dst) {
+
+	const WordCopy<TSource,W,Skip> copy(decompressor.marlinMostCommonSymbol);
+	finishKK<KK,O>(copy, decompressor.decompressorTablePointer, StreamState<TSource>(src, dst));
+}
+
+template<typename TSource, typename MarlinIdx, size_t KK, size_t O>
+auto selectSpecialized(size_t maxWordSize, bool isSkip) -> typename TMarlinDecompress<TSource,MarlinIdx>::DecodeFunction {
+
+	switch (maxWordSize) {
+	case  3: return isSkip ? &decodeSpecialized<TSource,MarlinIdx,KK,O, 3,true> : &decodeSpecialized<TSource,MarlinIdx,KK,O, 3,false>;
+	case  7: return isSkip ? &decodeSpecialized<TSource,MarlinIdx,KK,O, 7,true> : &decodeSpecialized<TSource,MarlinIdx,KK,O, 7,false>;
+	case 15: return isSkip ? &decodeSpecialized<TSource,MarlinIdx,KK,O,15,true> : &decodeSpecialized<TSource,MarlinIdx,KK,O,15,false>;
+	case 31: return isSkip ? &decodeSpecialized<TSource,MarlinIdx,KK,O,31,true> : &decodeSpecialized<TSource,MarlinIdx,KK,O,31,false>;
+	case 63: return isSkip ? &decodeSpecialized<TSource,MarlinIdx,KK,O,63,true> : &decodeSpecialized<TSource,MarlinIdx,KK,O,63,false>;
+	}
+	return nullptr;
+}
+
+template<typename TSource, typename MarlinIdx, size_t KK>
+auto selectSpecialized(size_t O, size_t maxWordSize, bool isSkip) -> typename TMarlinDecompress<TSource,MarlinIdx>::DecodeFunction {
+
+	switch (O) {
+	case 0: return selectSpecialized<TSource,MarlinIdx,KK,0>(maxWordSize, isSkip);
+	case 1: return selectSpecialized<TSource,MarlinIdx,KK,1>(maxWordSize, isSkip);
+	case 2: return selectSpecialized<TSource,MarlinIdx,KK,2>(maxWordSize, isSkip);
+	case 3: return selectSpecialized<TSource,MarlinIdx,KK,3>(maxWordSize, isSkip);
+	case 4: return selectSpecialized<TSource,MarlinIdx,KK,4>(maxWordSize, isSkip);
+	}
+	return nullptr;
+}
+
+template<typename TSource, typename MarlinIdx>
+auto selectSpecialized(size_t K, size_t O, size_t maxWordSize, bool isSkip) -> typename TMarlinDecompress<TSource,MarlinIdx>::DecodeFunction {
+
+	switch (K) {
+	case  4: return selectSpecialized<TSource,MarlinIdx, 4>(O, maxWordSize, isSkip);
+	case  5: return selectSpecialized<TSource,MarlinIdx, 5>(O, maxWordSize, isSkip);
+	case  6: return selectSpecialized<TSource,MarlinIdx, 6>(O, maxWordSize, isSkip);
+	case  7: return selectSpecialized<TSource,MarlinIdx, 7>(O, maxWordSize, isSkip);
+	case  8: return selectSpecialized<TSource,MarlinIdx, 8>(O, maxWordSize, isSkip);
+	case 10: return selectSpecialized<TSource,MarlinIdx,10>(O, maxWordSize, isSkip);
+	case 12: return selectSpecialized<TSource,MarlinIdx,12>(O, maxWordSize, isSkip);
+	case 14: return selectSpecialized<TSource,MarlinIdx,14>(O, maxWordSize, isSkip);
+	}
+	return nullptr;
+}
+
+}
+
+template<typename TSource, typename MarlinIdx>
+std::vector<DecodeKernel<TSource,MarlinIdx>> marlin::decodeKernels(size_t K, size_t O, size_t maxWordSize, bool isSkip) {
+
+	std::vector<DecodeKernel<TSource,MarlinIdx>> ret;
+	auto specialized = selectSpecialized<TSource,MarlinIdx>(K, O, maxWordSize, isSkip);
+	if (specialized) 
+		ret.push_back({ "specialized", CpuLevel::Scalar, specialized });
+	ret.push_back({ "avx512", CpuLevel::AVX512, &decodeMarlinAVX512<TSource,MarlinIdx> });
+	ret.push_back({ "avx2",   CpuLevel::AVX2,   &decodeMarlinAVX2<TSource,MarlinIdx>   });
+	ret.push_back({ "bmi2",   CpuLevel::BMI2,   &decodeMarlinBMI2<TSource,MarlinIdx>   });
+	ret.push_back({ "scalar", CpuLevel::Scalar, &decodeMarlinScalar<TSource,MarlinIdx> });
+	// Skip dictionaries decode the same with the copy of non-skip ones (see decompressGeneric).
+	if (specialized and isSkip)
+		ret.push_back({ "specialized non-skip", CpuLevel::Scalar, selectSpecialized<TSource,MarlinIdx>(K, O, maxWordSize, false) });
+	ret.push_back({ "slow",   CpuLevel::Scalar, &decodeSlow<TSource,MarlinIdx>         });
+	return ret;
+}
 
+template<typename TSource, typename MarlinIdx>
+auto TMarlinDecompress<TSource,MarlinIdx>::selectDecodeFunction(size_t K, size_t O, size_t maxWordSize, bool isSkip) -> DecodeFunction {
 
+	for (auto &&kernel : decodeKernels<TSource,MarlinIdx>(K, O, maxWordSize, isSkip))
+		if (cpuSupports(kernel.level)) return kernel.decode;
+	return &decodeMarlinScalar<TSource,MarlinIdx>;
 }
 
 template<typename TSource, typename MarlinIdx>
 std::unique_ptr<std::vector<TSource>> TMarlinDecompress<TSource,MarlinIdx>::buildDecompressorTable(
 	const TMarlinDictionary<TSource,MarlinIdx> &dictionary) const {
 	
+	BuildTimer timer(BuildPhase::DecompressorTable);
 	auto &&marlinAlphabet = dictionary.marlinAlphabet;
 	auto &&words = dictionary.words;
 	
-	auto ret = std::make_unique<std::vector<TSource>>(words.size()*(maxWordSize+1));
+	// Every K+O bit index has an entry, even if the dictionary has fewer words.
+	const size_t nWords = std::max(words.size(), size_t(1)<<(K+O));
+	auto ret = std::make_unique<std::vector<TSource>>(nWords*(maxWordSize+1));
 	
 	TSource *d = &ret->front();
 	for (size_t i=0; i<words.size(); i++) {
@@ -459,6 +552,71 @@ std::unique_ptr<std::vector<TSource>> TMarlinDecompress<TSource,MarlinIdx>::buil
 	return ret;
 }
 
+// Writes the unrepresented symbols over the most common symbol that the stream decoded
+// in their place. src holds the symbols, then the distances between their positions
+// packed in distanceBits each. Distances are read with a 64 bit load as long as that
+// stays before end (the end of the block), so only the bounds check is left to branch on.
+template<typename TSource>
+bool patchUnrepresented(View<const uint8_t> src, size_t n, size_t distanceBits, const uint8_t *end, View<TSource> dst) {
+
+	const uint8_t *distances = src.start + n*sizeof(TSource);
+	const uint64_t mask = (uint64_t(1)<<distanceBits)-1;
+	size_t i = 0, bit = 0, pos = 0;
+	
+	auto patch = [&](uint64_t v) {
+		pos += (v >> (bit%8)) & mask;
+		if (pos >= dst.nElements()) return false;
+		memcpy(&dst.start[pos], src.start + i*sizeof(TSource), sizeof(TSource));
+		return true;
+	};
+	
+	for (; i<n and distances+bit/8+sizeof(uint64_t) <= end; i++, bit += distanceBits) {
+		uint64_t v;
+		memcpy(&v, distances+bit/8, sizeof(v));
+		if (not patch(v)) return false;
+	}
+	for (; i<n; i++, bit += distanceBits) {
+		uint64_t v = 0;
+		for (size_t j=0; j<(bit%8+distanceBits+7)/8; j++)
+			v |= uint64_t(distances[bit/8+j]) << (8*j);
+		if (not patch(v)) return false;
+	}
+	return true;
+}
+
+// Reads a varint from the start of src, and advances it.
+inline bool readVarint(View<const uint8_t> &src, size_t &v) {
+	
+	v = 0;
+	for (size_t bits = 0;; bits += 7) {
+		if (src.start == src.end or bits > 56) return false;
+		uint8_t b = *src.start++;
+		v |= size_t(b & 0x7F) << bits;
+		if (not (b & 0x80)) return true;
+	}
+}
+
+// The symbols of block were decoded without the runs, at its end from packed on. Going
+// from the first run to the last, the symbols before each run move to their place, which
+// is never after where they are, and the run is filled in (a memset for 8 bit sources).
+// The symbols after the last run are already in place. runs holds the nRuns (gap, length/8)
+// varints, already checked by decompress.
+template<typename TSource>
+void expandRuns(View<TSource> block, const TSource *packed, View<const uint8_t> runs, size_t nRuns, TSource symbol) {
+	
+	TSource *out = block.start;
+	for (size_t r=0; r<nRuns; r++) {
+		size_t gap, length;
+		readVarint(runs, gap);
+		readVarint(runs, length);
+		memmove(out, packed, gap*sizeof(TSource));
+		packed += gap;
+		out += gap;
+		std::fill(out, out+8*length, symbol);
+		out += 8*length;
+	}
+}
+
 template<typename TSource, typename MarlinIdx>
 ssize_t TMarlinDecompress<TSource,MarlinIdx>::decompress(View<const uint8_t> src, View<TSource> dst) const {
 
@@ -473,7 +631,8 @@ ssize_t TMarlinDecompress<TSource,MarlinIdx>::decompress(View<const uint8_t> src
 	
 	// Special case: the entire block is made of one symbol!
 	if (src.nBytes() == sizeof(TSource)) {
-		TSource s = *reinterpret_cast<const TSource *&>(src.start);
+		TSource s;
+		memcpy(&s, src.start, sizeof(TSource));
 		for (size_t i=0; i<dst.nElements(); i++)
 			dst.start[i] = s;
 		return dst.nElements();
@@ -487,31 +646,59 @@ ssize_t TMarlinDecompress<TSource,MarlinIdx>::decompress(View<const uint8_t> src
 
 	// Special case: if dstSize is not multiple of 8, we force it to be.
 	size_t padding = 0;
-	while ( dst.nBytes() % 8 != 0) {
+	while ( dst.nElements() % 8 != 0) {
 		
-		*dst.start++ = *reinterpret_cast<const TSource *&>(src.start)++;			
-		padding += sizeof(TSource);
+		TSource s;
+		memcpy(&s, src.start, sizeof(TSource));
+		src.start += sizeof(TSource);
+		*dst.start++ = s;
+		padding++;
 	}
+	if (dst.nElements() == 0) return padding;
 	
-	ssize_t nUnrepresentedSymbols = *src.start++;
+	// See TMarlinCompress::compressBlock for the layout of the block.
+	size_t count;
+	if (not readVarint(src, count)) return -1;
+	const bool hasRuns = count & 1;
+	const size_t nUnrepresented = count >> 1;
 	
-	ssize_t unrepresentedSize = nUnrepresentedSymbols * ( sizeof(TSource) + (
-		dst.nElements() < 0x100 ? sizeof(uint8_t) :
-		dst.nElements() < 0x10000 ? sizeof(uint16_t) :
-		dst.nElements() < 0x100000000ULL ? sizeof(uint32_t) :sizeof(uint64_t)
-		));
+	// The symbols left once the runs were cut out are decoded at the end of the block,
+	// and spread out over it once decoded. The run list is only checked here, and read
+	// again to expand the runs.
+	const View<TSource> block = dst;
+	View<const uint8_t> runs;
+	size_t nRuns = 0;
+	if (hasRuns) {
+		if (not readVarint(src, nRuns) or nRuns == 0 or nRuns > block.nElements()/8) return -1;
+		runs = src;
+		size_t previousEnd = 0;
+		for (size_t r=0; r<nRuns; r++) {
+			size_t gap, length;
+			if (not readVarint(src, gap) or not readVarint(src, length)) return -1;
+			if (gap > block.nElements()-previousEnd or length > (block.nElements()-previousEnd-gap)/8) return -1;
+			previousEnd += gap + 8*length;
+			dst.start += 8*length;
+		}
+		if (dst.nElements() == 0) return -1;
+		runs.end = src.start;
+	}
+	if (nUnrepresented > dst.nElements()) return -1;
 	
 	ssize_t residualSize = dst.nElements()*shift/8;
+	if (src.end-src.start < residualSize) return -1;
+
+	ssize_t unrepresentedSize = 0;
+	size_t distanceBits = 0;
+	if (nUnrepresented) {
+		const uint8_t *unrepresentedEnd = src.end-residualSize;
+		if (unrepresentedEnd == src.start) return -1;
+		distanceBits = unrepresentedEnd[-1];
+		if (distanceBits > 56) return -1;
+		unrepresentedSize = nUnrepresented*sizeof(TSource) + (nUnrepresented*distanceBits+7)/8 + 1;
+	}
 
 	ssize_t marlinSize = src.end-src.start-unrepresentedSize-residualSize;
-
-	
-	// Initialization, which might be optional
-	if (not isSkip) {
-		TSource s = marlinMostCommonSymbol;
-		for (size_t i=0; i<dst.nElements(); i++)
-			dst.start[i] = s;
-	}
+	if (marlinSize < 0) return -1;
 
 	View<const uint8_t> marlinSrc =
 		marlin::make_view(src.start,src.start+marlinSize);
@@ -520,37 +707,50 @@ ssize_t TMarlinDecompress<TSource,MarlinIdx>::decompress(View<const uint8_t> src
 	View<const uint8_t> shiftSrc  = 
 		marlin::make_view(unrepresentedSrc.end,unrepresentedSrc.end+residualSize);
 
-	if (false) {
-		//decompressSlow(marlinSrc, dst);
-	} else if (maxWordSize==3) {
-		decompressFast<uint32_t>(*this,marlinSrc, dst);
-	} else if (maxWordSize==7) {
-		decompressFast<uint64_t>(*this,marlinSrc, dst);
-	} else {
-		//printf("Slow because: %lu %lu\n",K, maxWordSize);
-		decompressSlow(*this, marlinSrc, dst);
-	}
+	decodeFunction(*this, marlinSrc, dst);
 	
-	//if (nUnrepresentedSymbols) printf("%u %u %u\n",  nUnrepresentedSymbols, unrepresentedSize, dst.nElements());
-	// Place unrepresented symbols
-	while (unrepresentedSrc.start < unrepresentedSrc.end) {
-
-		size_t idx;
-		if (dst.nElements() < 0x100) {
-			idx = *reinterpret_cast<const uint8_t *&>(unrepresentedSrc.start)++;
-		} else if (dst.nElements() < 0x10000) {
-			idx = *reinterpret_cast<const uint16_t *&>(unrepresentedSrc.start)++;
-		} else if (dst.nElements() < 0x100000000ULL) {
-			idx = *reinterpret_cast<const uint32_t *&>(unrepresentedSrc.start)++;
-		} else {
-			idx = *reinterpret_cast<const uint64_t *&>(unrepresentedSrc.start)++;
-		}
-//			printf("%d \n", idx, *reinterpret_cast<const TSource *&>(unrepresentedSrc.start));
-		dst.start[idx] = *reinterpret_cast<const TSource *&>(unrepresentedSrc.start)++;
-//			printf("%llu %llu\n", unrepresentedSrc.start, unrepresentedSrc.end);
+	if (nUnrepresented and not patchUnrepresented(unrepresentedSrc, nUnrepresented, distanceBits, src.end, dst)) return -1;
+	
+	shift8(*this, shiftSrc, dst);
+	
+	if (hasRuns) expandRuns(block, dst.start, runs, nRuns, marlinMostCommonSymbol);
+	
+	return padding + block.nElements();
+}
+
+template<typename TSource, typename MarlinIdx>
+ssize_t TMarlinDecompress<TSource,MarlinIdx>::decompressParallel(View<const uint8_t> src, View<TSource> dst, size_t nThreads) const {
+
+	// See TMarlinCompress::compressParallel for the frame layout.
+	if (src.nBytes() < 2*sizeof(uint32_t)) return -1;
+	const size_t chunkSize = loadLE32(src.start);
+	const size_t nChunks = loadLE32(src.start + sizeof(uint32_t));
+	const uint8_t *chunkSizes = src.start + 2*sizeof(uint32_t);
+
+	if (chunkSize == 0 and dst.nElements()) return -1;
+	if (chunkSize and nChunks != (dst.nElements() + chunkSize - 1) / chunkSize) return -1;
+	if (src.nBytes() < (2 + nChunks) * sizeof(uint32_t)) return -1;
+
+	// Offsets in src of the chunk payloads, each checked before the next one is taken.
+	std::vector<size_t> chunkPositions(nChunks+1);
+	chunkPositions[0] = (2 + nChunks) * sizeof(uint32_t);
+	for (size_t i=0; i<nChunks; i++) {
+		chunkPositions[i+1] = chunkPositions[i] + loadLE32(chunkSizes + i*sizeof(uint32_t));
+		if (chunkPositions[i+1] > src.nBytes()) return -1;
 	}
-			
-	return padding + shift8(*this, shiftSrc, dst);
+
+	std::atomic<bool> failed(false);
+	parallelFor(nChunks, nThreads, [&](size_t i) {
+		
+		size_t sz = std::min(chunkSize, dst.nElements() - i*chunkSize);
+		auto in  = marlin::make_view(src.start + chunkPositions[i], src.start + chunkPositions[i+1]);
+		auto out = marlin::make_view(dst.start + i*chunkSize, dst.start + i*chunkSize + sz);
+		
+		if (decompress(in, out) < 0) failed = true;
+	});
+	if (failed) return -1;
+
+	return dst.nElements();
 }
 
 ////////////////////////////////////////////////////////////////////////
@@ -558,6 +758,8 @@ ssize_t TMarlinDecompress<TSource,MarlinIdx>::decompress(View<const uint8_t> src
 // Explicit Instantiations
 #include "instantiations.h"
 INSTANTIATE(TMarlinDecompress)	
+template std::vector<DecodeKernel<uint8_t,uint8_t>> marlin::decodeKernels<uint8_t,uint8_t>(size_t K, size_t O, size_t maxWordSize, bool isSkip);
+template std::vector<DecodeKernel<uint16_t,uint8_t>> marlin::decodeKernels<uint16_t,uint8_t>(size_t K, size_t O, size_t maxWordSize, bool isSkip);
 
 //INSTANTIATE_MEMBER(TMarlinDecompress,buildDecompressorTable(const TMarlinDictionary<TSource,MarlinIdx> &dictionary) const -> std::unique_ptr<std::vector<typename TMarlin::TSource_Type>>)	
 //INSTANTIATE_MEMBER(TMarlinDecompress,decompress(View<const uint8_t> src, View<typename TMarlin::TSource_Type> dst) const -> ssize_t)	
@@ -0,0 +1,244 @@
+/***********************************************************************
+
+estimate: cheap prediction of the compressed size of a block
+
+MIT License
+
+Copyright (c) 2017 Manuel Martinez Torres
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+***********************************************************************/
+
+
+#include <marlin.h>
+
+#include <cstring>
+#include <algorithm>
+#include <cmath>
+#include <immintrin.h>
+
+using namespace marlin;
+
+////////////////////////////////////////////////////////////////////////
+//
+// Histogram
+
+namespace {
+
+// Consecutive equal bytes would serialize on the same counter, so bytes are spread
+// over four tables that are only added together at the end.
+typedef uint32_t ByteCounters[4][256];
+
+// Counters of 32 bits are enough for each round of up to 2^32-1 bytes per table.
+constexpr size_t ROUND = 0xFFFFFFFFULL*4 & ~size_t(15);
+
+inline void count8(ByteCounters &t, const uint8_t *in) {
+	uint64_t v;
+	memcpy(&v, in, sizeof(v));
+	t[0][(v >>  0) & 0xFF]++;
+	t[1][(v >>  8) & 0xFF]++;
+	t[2][(v >> 16) & 0xFF]++;
+	t[3][(v >> 24) & 0xFF]++;
+	t[0][(v >> 32) & 0xFF]++;
+	t[1][(v >> 40) & 0xFF]++;
+	t[2][(v >> 48) & 0xFF]++;
+	t[3][(v >> 56) & 0xFF]++;
+}
+
+inline void addCounters(std::array<size_t, 256> &ret, const ByteCounters &t) {
+	for (size_t i=0; i<256; i++)
+		ret[i] += size_t(t[0][i]) + t[1][i] + t[2][i] + t[3][i];
+}
+
+}
+
+template<>
+std::array<size_t, 256> marlin::histogram(View<const uint8_t> src) {
+	
+	std::array<size_t, 256> ret;
+	ret.fill(0);
+	
+	const uint8_t *in = src.start;
+	while (in < src.end) {
+		
+		ByteCounters t = {};
+		const uint8_t *end = in + std::min(size_t(src.end - in), ROUND);
+		for (; in + 8 <= end; in += 8)
+			count8(t, in);
+		for (; in < end; in++)
+			t[0][*in]++;
+		
+		addCounters(ret, t);
+	}
+	return ret;
+}
+
+// 16 bit sources spread over many more counters, so repeated symbols rarely collide.
+template<>
+SymbolArray<uint16_t,size_t> marlin::histogram(View<const uint16_t> src) {
+	
+	SymbolArray<uint16_t,size_t> ret;
+	ret.fill(0);
+	for (const uint16_t *in = src.start; in < src.end; in++)
+		ret[*in]++;
+	return ret;
+}
+
+// Same pass as histogram. Each vector of 16 bytes is also compared with the same bytes
+// shifted by one, and the equal lanes are counted in byte counters that are summed
+// before they can wrap.
+template<>
+void marlin::blockStats(View<const uint8_t> src, BlockStats<uint8_t> &ret) {
+	
+	ret.histogram.fill(0);
+	ret.nElements = src.nElements();
+	ret.nRepeated = 0;
+	if (src.nElements() == 0) return;
+	
+	// The first byte has nothing before it to repeat.
+	const uint8_t *in = src.start;
+	ret.histogram[*in++]++;
+	
+	while (in < src.end) {
+		
+		ByteCounters t = {};
+		const uint8_t *end = in + std::min(size_t(src.end - in), ROUND);
+		while (in + 16 <= end) {
+			const uint8_t *chunkEnd = in + std::min(size_t(end - in)/16, size_t(255))*16;
+			__m128i repeated = _mm_setzero_si128();
+			for (; in < chunkEnd; in += 16) {
+				__m128i v    = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in));
+				__m128i prev = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in-1));
+				repeated = _mm_sub_epi8(repeated, _mm_cmpeq_epi8(v, prev));
+				count8(t, in);
+				count8(t, in+8);
+			}
+			__m128i sums = _mm_sad_epu8(repeated, _mm_setzero_si128());
+			ret.nRepeated += size_t(_mm_cvtsi128_si64(sums)) + size_t(_mm_cvtsi128_si64(_mm_unpackhi_epi64(sums, sums)));
+		}
+		for (; in < end; in++) {
+			t[0][*in]++;
+			ret.nRepeated += in[0] == in[-1];
+		}
+		
+		addCounters(ret.histogram, t);
+	}
+}
+
+template<>
+void marlin::blockStats(View<const uint16_t> src, BlockStats<uint16_t> &ret) {
+	
+	ret.histogram.fill(0);
+	ret.nElements = src.nElements();
+	ret.nRepeated = 0;
+	if (src.nElements() == 0) return;
+	
+	ret.histogram[src.start[0]]++;
+	for (const uint16_t *in = src.start+1; in < src.end; in++) {
+		ret.histogram[*in]++;
+		ret.nRepeated += in[0] == in[-1];
+	}
+}
+
+////////////////////////////////////////////////////////////////////////
+//
+// Cost model
+
+// Marlin words are close to equiprobable, so the frequency of each Marlin symbol
+// among the symbols of all words approximates the probability the dictionary was
+// built for. The cost of a symbol is its information under that model, scaled so
+// that the model source costs what the dictionary efficiency says it does. Residuals
+// cost shift bits, and unrepresented symbols pay for their exception entry (the same
+// terms as TMarlinDictionary::calcEfficiency).
+template<typename TSource, typename MarlinIdx>
+auto TMarlin<TSource,MarlinIdx>::buildSymbolCost() const -> SymbolCost {
+	
+	const size_t nWords = 1U<<(K+O);
+	const size_t nMarlinSymbols = this->unrepresentedSymbolToken;
+	
+	// The table only stores the first maxWordSize symbols of each word; the rest are
+	// the most common symbol, which the decoder does not need to write.
+	const size_t mostCommon = this->source2marlin[this->marlinMostCommonSymbol>>shift];
+	
+	std::vector<double> count(nMarlinSymbols+1, 0.);
+	double totalLength = 0;
+	for (size_t w=0; w<nWords; w++) {
+		const TSource *word = &this->decompressorTablePointer[w*(maxWordSize+1)];
+		const size_t length = word[maxWordSize];
+		for (size_t j=0; j<std::min(length, maxWordSize); j++)
+			count[this->source2marlin[word[j]>>shift]]++;
+		if (length > maxWordSize)
+			count[mostCommon] += length - maxWordSize;
+		totalLength += length;
+	}
+	
+	// Symbols that never made it into a word still get a small probability.
+	for (size_t m=0; m<nMarlinSymbols; m++)
+		if (count[m] == 0.) count[m] = 0.5;
+	
+	double entropy = 0;
+	std::vector<double> information(nMarlinSymbols);
+	for (size_t m=0; m<nMarlinSymbols; m++) {
+		information[m] = -std::log2(count[m] / totalLength);
+		entropy += count[m] / totalLength * information[m];
+	}
+	
+	// Residuals are taken as incompressible, so the model source has entropy+shift bits.
+	const double bitsPerSymbol = (entropy + shift) / this->efficiency - shift;
+	const double scale = entropy > 0 ? bitsPerSymbol / entropy : 0;
+	
+	SymbolCost ret;
+	for (size_t s=0; s<ret.size(); s++) {
+		const size_t m = this->source2marlin[s>>shift];
+		if (m < nMarlinSymbols)
+			ret[s] = shift + information[m]*scale;
+		else // Encoded as the most probable symbol, plus its exception entry
+			ret[s] = shift + information[0]*scale + 8*(2+sizeof(TSource));
+	}
+	return ret;
+}
+
+template<typename TSource, typename MarlinIdx>
+double TMarlin<TSource,MarlinIdx>::estimateSize(const Histogram &hist) const {
+	
+	double bits = 0;
+	size_t nElements = 0;
+	for (size_t s=0; s<hist.size(); s++) {
+		bits += hist[s]*symbolCost[s];
+		nElements += hist[s];
+	}
+	
+	// Blocks that do not compress are stored raw.
+	const double raw = nElements*sizeof(TSource);
+	return std::min(raw, bits/8);
+}
+
+template<typename TSource, typename MarlinIdx>
+double TMarlin<TSource,MarlinIdx>::estimateSize(const BlockStats<TSource> &stats) const {
+	
+	if (stats.isSingleSymbol()) return sizeof(TSource);
+	return estimateSize(stats.histogram);
+}
+
+////////////////////////////////////////////////////////////////////////
+//
+// Explicit Instantiations
+#include "instantiations.h"
+INSTANTIATE(TMarlin)
@@ -0,0 +1,162 @@
+/***********************************************************************
+
+frame: self-describing container for Marlin blocks
+
+MIT License
+
+Copyright (c) 2017 Manuel Martinez Torres
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+***********************************************************************/
+
+#include <marlin.h>
+
+#include <cstring>
+
+#include "checksum.hpp"
+#include "frame.hpp"
+
+using namespace marlin;
+
+template<typename TSource, typename MarlinIdx>
+uint32_t TMarlin<TSource,MarlinIdx>::buildId() const {
+	
+	const uint64_t params[] = { K, O, shift, maxWordSize, uint64_t(this->marlinMostCommonSymbol) };
+	
+	XXHash64 hash;
+	hash.update(params, sizeof(params));
+	hash.update(this->decompressorTablePointer, (size_t(1)<<(K+O)) * (maxWordSize+1) * sizeof(TSource));
+	return uint32_t(hash.digest());
+}
+
+template<typename TSource, typename MarlinIdx>
+size_t TMarlin<TSource,MarlinIdx>::frameBound(size_t nElements, size_t blockSize) {
+	
+	if (blockSize == 0) blockSize = FRAME_DEFAULT_BLOCK_SIZE;
+	size_t nBlocks = (nElements + blockSize - 1) / blockSize;
+	return sizeof(FrameHeader) + nBlocks*sizeof(uint32_t) + nElements*sizeof(TSource) + sizeof(uint64_t);
+}
+
+template<typename TSource, typename MarlinIdx>
+ssize_t TMarlin<TSource,MarlinIdx>::compressFrame(View<const TSource> src, View<uint8_t> dst, bool checksum, size_t blockSize) const {
+	
+	if (blockSize == 0) blockSize = FRAME_DEFAULT_BLOCK_SIZE;
+	if (blockSize > 0xFFFFFFFFULL) return -1;
+	if (dst.nBytes() < frameBound(src.nElements(), blockSize)) return -1;
+	
+	FrameHeader header = makeFrameHeader(checksum ? FRAME_FLAG_CHECKSUM : 0, sizeof(TSource), id, blockSize, src.nElements());
+	writeFrameHeader(header, dst.start);
+	
+	const size_t nBlocks = (src.nElements() + blockSize - 1) / blockSize;
+	uint8_t *table = dst.start + sizeof(FrameHeader);
+	uint8_t *out = table + nBlocks*sizeof(uint32_t);
+	
+	// Each block is hashed right after it is compressed, while it is still in cache.
+	MarlinWorkspace workspace;
+	XXHash64 hash;
+	for (size_t i=0; i<nBlocks; i++) {
+		
+		auto block = marlin::make_view(src.start + i*blockSize, src.start + std::min((i+1)*blockSize, src.nElements()));
+		ssize_t r = this->compress(block, marlin::make_view(out, dst.end), workspace);
+		if (r < 0) return -1;
+		
+		storeLE32(table + i*sizeof(uint32_t), r);
+		out += r;
+		
+		if (checksum)
+			hash.update(block.start, block.nBytes());
+	}
+	
+	if (checksum) {
+		storeLE64(out, hash.digest());
+		out += sizeof(uint64_t);
+	}
+	return out - dst.start;
+}
+
+template<typename TSource, typename MarlinIdx>
+ssize_t TMarlin<TSource,MarlinIdx>::decompressFrame(View<const uint8_t> src, View<TSource> dst) const {
+	
+	FrameHeader header;
+	if (not readFrameHeader<TSource>(src, header) or (header.flags & FRAME_FLAG_STREAMED)) return -1;
+	if (header.dictionaryId != id) return -1;
+	if (header.contentSize != dst.nElements()) return -1;
+	
+	const size_t nBlocks = (header.contentSize + header.blockSize - 1) / header.blockSize;
+	const size_t checksumSize = (header.flags & FRAME_FLAG_CHECKSUM) ? sizeof(uint64_t) : 0;
+	if (src.nBytes() < sizeof(FrameHeader) + checksumSize) return -1;
+	if ((src.nBytes() - sizeof(FrameHeader) - checksumSize) / sizeof(uint32_t) < nBlocks) return -1;
+	
+	const uint8_t *table = src.start + sizeof(FrameHeader);
+	const uint8_t *in = table + nBlocks*sizeof(uint32_t);
+	
+	// As in compressFrame, each block is hashed while it is still in cache.
+	XXHash64 hash;
+	for (size_t i=0; i<nBlocks; i++) {
+		
+		const uint32_t compressedSize = loadLE32(table + i*sizeof(uint32_t));
+		if (compressedSize > size_t(src.end - in) - checksumSize) return -1;
+		
+		auto block = marlin::make_view(dst.start + i*header.blockSize, dst.start + std::min((i+1)*size_t(header.blockSize), dst.nElements()));
+		if (this->decompress(marlin::make_view(in, in + compressedSize), block) != ssize_t(block.nElements())) return -1;
+		in += compressedSize;
+		
+		if (checksumSize)
+			hash.update(block.start, block.nBytes());
+	}
+	
+	if (checksumSize) {
+		if (loadLE64(in) != hash.digest()) return -1;
+	}
+	return dst.nElements();
+}
+
+template<typename TSource, typename MarlinIdx>
+ssize_t TMarlin<TSource,MarlinIdx>::frameContentSize(View<const uint8_t> src) {
+	
+	FrameHeader header;
+	if (not readFrameHeader<TSource>(src, header) or (header.flags & FRAME_FLAG_STREAMED)) return -1;
+	return header.contentSize;
+}
+
+template<typename TSource, typename MarlinIdx>
+int64_t TMarlin<TSource,MarlinIdx>::frameDictionaryId(View<const uint8_t> src) {
+	
+	FrameHeader header;
+	if (not readFrameHeader<TSource>(src, header)) return -1;
+	return header.dictionaryId;
+}
+
+////////////////////////////////////////////////////////////////////////
+//
+// Explicit Instantiations
+// (TMarlin itself is instantiated in estimate.cc)
+template uint32_t marlin::TMarlin<uint8_t,uint8_t>::buildId() const;
+template size_t marlin::TMarlin<uint8_t,uint8_t>::frameBound(size_t nElements, size_t blockSize);
+template ssize_t marlin::TMarlin<uint8_t,uint8_t>::compressFrame(View<const uint8_t> src, View<uint8_t> dst, bool checksum, size_t blockSize) const;
+template ssize_t marlin::TMarlin<uint8_t,uint8_t>::decompressFrame(View<const uint8_t> src, View<uint8_t> dst) const;
+template ssize_t marlin::TMarlin<uint8_t,uint8_t>::frameContentSize(View<const uint8_t> src);
+template int64_t marlin::TMarlin<uint8_t,uint8_t>::frameDictionaryId(View<const uint8_t> src);
+template uint32_t marlin::TMarlin<uint16_t,uint8_t>::buildId() const;
+template size_t marlin::TMarlin<uint16_t,uint8_t>::frameBound(size_t nElements, size_t blockSize);
+template ssize_t marlin::TMarlin<uint16_t,uint8_t>::compressFrame(View<const uint16_t> src, View<uint8_t> dst, bool checksum, size_t blockSize) const;
+template ssize_t marlin::TMarlin<uint16_t,uint8_t>::decompressFrame(View<const uint8_t> src, View<uint16_t> dst) const;
+template ssize_t marlin::TMarlin<uint16_t,uint8_t>::frameContentSize(View<const uint8_t> src);
+template int64_t marlin::TMarlin<uint16_t,uint8_t>::frameDictionaryId(View<const uint8_t> src);
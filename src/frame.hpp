@@ -0,0 +1,144 @@
+/***********************************************************************
+
+frame: layout of the self-describing container for Marlin blocks
+
+MIT License
+
+Copyright (c) 2017 Manuel Martinez Torres
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+***********************************************************************/
+
+#ifndef MARLIN_FRAME_HPP
+#define MARLIN_FRAME_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <marlin.h>
+
+// Frame layout (all fields little endian, whatever the host):
+//   FrameHeader
+//   compressedSize        nBlocks uint32_t, nBlocks = ceil(contentSize/blockSize)
+//   blocks                regular Marlin blocks, as produced by compress
+//   checksum              uint64_t XXH64 of the content bytes, if FRAME_FLAG_CHECKSUM
+// Every block holds blockSize symbols except the last one, so the header and the
+// table are enough to locate and size every block before decoding any of them.
+//
+// Streamed frames (FRAME_FLAG_STREAMED) are written before their size is known, so
+// contentSize is 0 and each block is preceded by its own entry instead:
+//   FrameHeader
+//   { uint32_t nElements, uint32_t compressedSize, block } for every block
+//   uint32_t 0, uint32_t 0
+//   checksum              uint64_t, if FRAME_FLAG_CHECKSUM
+
+namespace marlin {
+
+constexpr char FRAME_MAGIC[4] = {'M','R','L','F'};
+constexpr uint8_t FRAME_VERSION = 1;
+constexpr uint8_t FRAME_FLAG_CHECKSUM = 1;
+constexpr uint8_t FRAME_FLAG_STREAMED = 2;
+constexpr size_t FRAME_DEFAULT_BLOCK_SIZE = 1U<<16;
+
+struct FrameHeader {
+	char magic[4];
+	uint8_t version;
+	uint8_t flags;
+	uint8_t sourceSize;           // sizeof(TSource)
+	uint8_t reserved;
+	uint32_t dictionaryId;
+	uint32_t blockSize;
+	uint64_t contentSize;         // In symbols
+};
+static_assert(sizeof(FrameHeader) == 24, "FrameHeader must not have padding");
+
+// Fields are stored byte by byte, which compilers turn into a plain move on little
+// endian hosts.
+inline void storeLE32(uint8_t *p, uint32_t v) {
+	for (size_t i=0; i<sizeof(v); i++) p[i] = uint8_t(v >> (8*i));
+}
+
+inline void storeLE64(uint8_t *p, uint64_t v) {
+	for (size_t i=0; i<sizeof(v); i++) p[i] = uint8_t(v >> (8*i));
+}
+
+inline uint32_t loadLE32(const uint8_t *p) {
+	uint32_t v = 0;
+	for (size_t i=0; i<sizeof(v); i++) v |= uint32_t(p[i]) << (8*i);
+	return v;
+}
+
+inline uint64_t loadLE64(const uint8_t *p) {
+	uint64_t v = 0;
+	for (size_t i=0; i<sizeof(v); i++) v |= uint64_t(p[i]) << (8*i);
+	return v;
+}
+
+// Writes header to the sizeof(FrameHeader) bytes at dst.
+inline void writeFrameHeader(const FrameHeader &header, uint8_t *dst) {
+	
+	memcpy(dst, header.magic, sizeof(header.magic));
+	dst[4] = header.version;
+	dst[5] = header.flags;
+	dst[6] = header.sourceSize;
+	dst[7] = header.reserved;
+	storeLE32(dst +  8, header.dictionaryId);
+	storeLE32(dst + 12, header.blockSize);
+	storeLE64(dst + 16, header.contentSize);
+}
+
+// Reads the header at src. Returns false if src does not start with a valid one.
+template<typename TSource>
+bool readFrameHeader(View<const uint8_t> src, FrameHeader &header) {
+	
+	if (src.nBytes() < sizeof(FrameHeader)) return false;
+	memcpy(header.magic, src.start, sizeof(header.magic));
+	header.version = src.start[4];
+	header.flags = src.start[5];
+	header.sourceSize = src.start[6];
+	header.reserved = src.start[7];
+	header.dictionaryId = loadLE32(src.start + 8);
+	header.blockSize = loadLE32(src.start + 12);
+	header.contentSize = loadLE64(src.start + 16);
+	
+	return memcmp(header.magic, FRAME_MAGIC, sizeof(FRAME_MAGIC)) == 0 and 
+		header.version == FRAME_VERSION and
+		header.sourceSize == sizeof(TSource) and
+		header.blockSize != 0;
+}
+
+inline FrameHeader makeFrameHeader(uint8_t flags, uint8_t sourceSize, uint32_t dictionaryId, uint32_t blockSize, uint64_t contentSize) {
+	
+	FrameHeader header;
+	memcpy(header.magic, FRAME_MAGIC, sizeof(FRAME_MAGIC));
+	header.version = FRAME_VERSION;
+	header.flags = flags;
+	header.sourceSize = sourceSize;
+	header.reserved = 0;
+	header.dictionaryId = dictionaryId;
+	header.blockSize = blockSize;
+	header.contentSize = contentSize;
+	return header;
+}
+
+}
+
+#endif /* MARLIN_FRAME_HPP */
@@ -37,6 +37,7 @@ SOFTWARE.
 #include "imageBlockEC.hpp"
 #include "profiler.hpp"
 #include "distribution.hpp"
+#include "parallel.hpp"
 
 namespace marlin {
 
@@ -67,7 +68,7 @@ size_t ImageMarlinBlockEC::decodeBlocks(
 		// To minimize cache mess, we uncompress together the blocks that use the same dictionary.
 		std::sort(blocksDictionary.begin(), blocksDictionary.end());
 
-		for (size_t sd = 0; sd < nBlocks; sd++) {
+		auto decodeBlock = [&](size_t sd) {
 
 			auto dict_index = blocksDictionary[sd].first;
 			auto i = blocksDictionary[sd].second;
@@ -82,7 +83,15 @@ size_t ImageMarlinBlockEC::decodeBlocks(
 					&uncompressed[i * blockSize + usz]);
 
 			Marlin_get_prebuilt_dictionaries()[dict_index]->decompress(in, out);
-		}
+		};
+
+		// Workers take consecutive runs of the sorted list, so each one
+		// still decodes the blocks of a dictionary together.
+		const size_t nRuns = (nBlocks + DECODE_RUN_LENGTH - 1) / DECODE_RUN_LENGTH;
+		parallelFor(nRuns, decodeThreads, [&](size_t run) {
+			for (size_t sd = run * DECODE_RUN_LENGTH; sd < std::min(nBlocks, (run + 1) * DECODE_RUN_LENGTH); sd++)
+				decodeBlock(sd);
+		});
 		return uncompressed.nBytes();
 	}
 }
@@ -94,10 +103,19 @@ size_t ImageMarlinBlockEC::decodeBlocks(
 std::vector<uint8_t> LaplacianBlockEC::encodeBlocks(
 		const std::vector<uint8_t> &uncompressed,
 		size_t blockSize) {
+	std::vector<uint8_t> out;
+	encodeBlocks(uncompressed, blockSize, out);
+	return out;
+}
+
+void LaplacianBlockEC::encodeBlocks(
+		const std::vector<uint8_t> &uncompressed,
+		size_t blockSize,
+		std::vector<uint8_t> &out) {
 	const size_t nBlocks = (uncompressed.size()+blockSize-1)/blockSize;
 
 	Profiler::start("ec_block_entropy");
-	std::vector<std::pair<uint8_t, size_t>> blocksEntropy;
+	blocksEntropy.clear();
 	// Calculate entropy only for 1 out of entropy_frequency block
 	double calculated_entropy = 0;
 	for (size_t i=0; i<nBlocks; i++) {
@@ -130,8 +148,8 @@ std::vector<uint8_t> LaplacianBlockEC::encodeBlocks(
 
 	// Compress
 	Profiler::start("ec_dictionary_coding");
-	std::vector<uint8_t> ec_header(nBlocks*3);
-	std::vector<uint8_t> scratchPad(nBlocks * blockSize);
+	ec_header.resize(nBlocks*3);
+	scratchPad.resize(nBlocks * blockSize);
 	for (size_t b=0; b<nBlocks; b++) {
 
 		size_t i = blocksEntropy[b].second;
@@ -139,9 +157,9 @@ std::vector<uint8_t> LaplacianBlockEC::encodeBlocks(
 		size_t sz = std::min(blockSize, uncompressed.size()-i*blockSize);
 
 		auto in  = marlin::make_view(&uncompressed[i*blockSize], &uncompressed[i*blockSize+sz]);
-		auto out = marlin::make_view(&scratchPad[i*blockSize], &scratchPad[i*blockSize+blockSize]);
+		auto dst = marlin::make_view(&scratchPad[i*blockSize], &scratchPad[i*blockSize+blockSize]);
 
-		size_t compressedSize = prebuilt_dictionaries[(entropy*16)/256]->compress(in, out);
+		size_t compressedSize = prebuilt_dictionaries[(entropy*16)/256]->compress(in, dst, workspace);
 
 		ec_header[3*i+0]=&prebuilt_dictionaries[(entropy*16)/256] - Marlin_get_prebuilt_dictionaries();
 		ec_header[3*i+1]=compressedSize  & 0xFF;
@@ -156,7 +174,7 @@ std::vector<uint8_t> LaplacianBlockEC::encodeBlocks(
 		fullCompressedSize += compressedSize;
 	}
 
-	std::vector<uint8_t> out(fullCompressedSize);
+	out.resize(fullCompressedSize);
 
 	memcpy(&out[0], ec_header.data(), ec_header.size());
 	{
@@ -167,50 +185,44 @@ std::vector<uint8_t> LaplacianBlockEC::encodeBlocks(
 			p+=compressedSize;
 		}
 	}
-
-	return out;
 }
 
-// Slow best-dictionary selection encoding
+// Best-dictionary selection encoding
 
 std::vector<uint8_t> ImageMarlinBestDictBlockEC::encodeBlocks(
 			const std::vector<uint8_t> &uncompressed, size_t blockSize) {
 
 	const size_t nBlocks = (uncompressed.size()+blockSize-1)/blockSize;
 
-	std::vector<std::pair<uint8_t, size_t>> blocksEntropy;
+	const Marlin **prebuilt_dictionaries = Marlin_get_prebuilt_dictionaries();
 
 	std::vector<uint8_t> ec_header(nBlocks*3);
-	std::vector<size_t> bestSizes(nBlocks, blockSize*2);
-	std::vector<std::vector<uint8_t>> bestBlocks(nBlocks, std::vector<uint8_t>(blockSize));
-	std::vector<uint8_t> scratchPad(blockSize);
-
-	for (auto **dict = Marlin_get_prebuilt_dictionaries(); *dict; dict++) {
+	std::vector<uint8_t> scratchPad(nBlocks * blockSize);
 
-		for (size_t i=0; i<nBlocks; i++) {
+	for (size_t i=0; i<nBlocks; i++) {
 
-			size_t sz = std::min(blockSize, uncompressed.size()-i*blockSize);
+		size_t sz = std::min(blockSize, uncompressed.size()-i*blockSize);
 
-			auto in  = marlin::make_view(&uncompressed[i*blockSize], &uncompressed[i*blockSize+sz]);
-			auto out = marlin::make_view(scratchPad);
+		// Estimated from the block histogram, instead of trying every dictionary
+		const Marlin *best = Marlin_estimate_best_dictionary(prebuilt_dictionaries, &uncompressed[i*blockSize], sz);
+		size_t dict_index = 0;
+		while (prebuilt_dictionaries[dict_index] != best) dict_index++;
 
-			size_t compressedSize = (size_t) (*dict)->compress(in, out);
+		auto in  = marlin::make_view(&uncompressed[i*blockSize], &uncompressed[i*blockSize+sz]);
+		auto out = marlin::make_view(&scratchPad[i*blockSize], &scratchPad[i*blockSize+blockSize]);
 
-			if (compressedSize<bestSizes[i]) {
-				bestSizes[i] = compressedSize;
+		size_t compressedSize = best->compress(in, out);
 
-				ec_header[3*i+0] = dict-Marlin_get_prebuilt_dictionaries();
-				ec_header[3*i+1] = compressedSize  & 0xFF;
-				ec_header[3*i+2] = compressedSize >> 8;
-				bestBlocks[i] = scratchPad;
-			}
-		}
+		ec_header[3*i+0] = dict_index;
+		ec_header[3*i+1] = compressedSize  & 0xFF;
+		ec_header[3*i+2] = compressedSize >> 8;
 	}
 
 	std::vector<uint8_t> compressedData = ec_header;
-	for (size_t i=0; i<nBlocks; i++)
-		for (size_t s = 0; s<bestSizes[i]; s++)
-			compressedData.push_back(bestBlocks[i][s]);
+	for (size_t i=0; i<nBlocks; i++) {
+		size_t compressedSize = (ec_header[3*i+2]<<8) + ec_header[3*i+1];
+		compressedData.insert(compressedData.end(), &scratchPad[i*blockSize], &scratchPad[i*blockSize+compressedSize]);
+	}
 
 	return compressedData;
 }
@@ -56,16 +56,29 @@ public:
 			const std::vector<uint8_t> &uncompressed,
 			size_t blockSize);
 
+	void encodeBlocks(
+			const std::vector<uint8_t> &uncompressed,
+			size_t blockSize,
+			std::vector<uint8_t> &out);
+
 protected:
 	ImageMarlinHeader header;
+
+	// Scratch buffers reused by encodeBlocks
+	std::vector<std::pair<uint8_t, size_t>> blocksEntropy;
+	std::vector<uint8_t> ec_header;
+	std::vector<uint8_t> scratchPad;
+	MarlinWorkspace workspace;
 };
 
 /**
- * Image block entropy coder that choses the best dictionary for
- * compression. Slow.
+ * Image block entropy coder that choses, for each block, the dictionary
+ * with the best estimated compression (see Marlin_estimate_best_dictionary).
  */
 class ImageMarlinBestDictBlockEC : public ImageMarlinBlockEC {
 public:
+	using ImageMarlinBlockEC::encodeBlocks;
+
 	std::vector<uint8_t> encodeBlocks(
 			const std::vector<uint8_t> &uncompressed,
 			size_t blockSize);
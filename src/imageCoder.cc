@@ -39,22 +39,35 @@ SOFTWARE.
 
 using namespace marlin;
 
-std::string ImageMarlinCoder::compress(const cv::Mat& orig_img) {
+std::string ImageMarlinCoder::compress(const cv::Mat& img) {
+	std::string out;
+	compress(img, out);
+	return out;
+}
+
+void ImageMarlinCoder::compress(const cv::Mat& img, std::ostream& out) {
+	compress(img, compressed);
+	out.write(compressed.data(), compressed.size());
+}
+
+void ImageMarlinCoder::compress(const cv::Mat& orig_img, std::string& out) {
 	const size_t bs = header.blockWidth;
 	const size_t brows = (orig_img.rows+bs-1)/bs;
 	const size_t bcols = (orig_img.cols+bs-1)/bs;
 	cv::Mat img;
 	{
 		if (brows * bs - orig_img.rows != 0 || bcols * bs - orig_img.cols != 0) {
-			cv::copyMakeBorder(orig_img, img, 0, brows * bs - orig_img.rows, 0, bcols * bs - orig_img.cols,
+			// paddedImage keeps its buffer while the image size does not change
+			cv::copyMakeBorder(orig_img, paddedImage, 0, brows * bs - orig_img.rows, 0, bcols * bs - orig_img.cols,
 			                   cv::BORDER_REPLICATE);
+			img = paddedImage;
 		} else {
 			img = orig_img;
 		}
 	}
 
-	std::vector<uint8_t> side_information(bcols*brows*img.channels());
-	std::vector<uint8_t> preprocessed(bcols*brows*bs*bs*img.channels());
+	side_information.resize(bcols*brows*img.channels());
+	preprocessed.resize(bcols*brows*bs*bs*img.channels());
 
 	if (header.channels != 1) {
 		throw std::runtime_error("Images with more than one component are not yet supported");
@@ -70,25 +83,25 @@ std::string ImageMarlinCoder::compress(const cv::Mat& orig_img) {
 	transformer->transform_direct(img1b.data, side_information, preprocessed);
 	Profiler::end("transformation");
 
-	// Write configuration header
-	std::ostringstream oss;
-	header.dump_to(oss);
-
-	// Write side information (block-representative pixels by default)
-	oss.write((const char *) side_information.data(), side_information.size());
+	// The configuration header never changes, so it is serialized only once
+	if (headerBytes.empty()) {
+		std::ostringstream oss;
+		header.dump_to(oss);
+		headerBytes = oss.str();
+	}
 
-	// Entropy code and write result
+	// Entropy code
 	Profiler::start("entropy_coding");
-	auto compressed = blockEC->encodeBlocks(preprocessed, bs* bs);
+	blockEC->encodeBlocks(preprocessed, bs* bs, entropyCoded);
 	Profiler::end("entropy_coding");
-	oss.write((const char *)compressed.data(), compressed.size());
-
-	return oss.str();
-}
 
-void ImageMarlinCoder::compress(const cv::Mat& img, std::ostream& out) {
-	const std::string compressed = compress(img);
-	out.write(compressed.data(), compressed.size());
+	// Write configuration header, side information (block-representative pixels
+	// by default) and the entropy coded blocks
+	out.clear();
+	out.reserve(headerBytes.size() + side_information.size() + entropyCoded.size());
+	out.append(headerBytes);
+	out.append((const char *) side_information.data(), side_information.size());
+	out.append((const char *) entropyCoded.data(), entropyCoded.size());
 }
 
 ImageMarlinCoder::~ImageMarlinCoder() {
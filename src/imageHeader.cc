@@ -64,7 +64,7 @@ ImageMarlinCoder* ImageMarlinHeader::newCoder() {
 	return new ImageMarlinCoder(*this, transformer, blockEC);
 }
 
-ImageMarlinDecoder* ImageMarlinHeader::newDecoder() {
+ImageMarlinDecoder* ImageMarlinHeader::newDecoder(size_t decodeThreads) {
 	// Get the right subclass depending on the parameters
 	ImageMarlinTransformer* transformer = nullptr;
 	ImageMarlinBlockEC* blockEC = nullptr;
@@ -84,6 +84,7 @@ ImageMarlinDecoder* ImageMarlinHeader::newDecoder() {
 	if (transformer == nullptr || blockEC == nullptr) {
 		throw std::runtime_error("Invalid transform / quantizer combination");
 	}
+	blockEC->decodeThreads = decodeThreads;
 
 	return new ImageMarlinDecoder(*this, transformer, blockEC);
 }
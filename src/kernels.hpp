@@ -0,0 +1,76 @@
+/***********************************************************************
+
+kernels: every encoder and decoder of Marlin streams, to test them one by one
+
+MIT License
+
+Copyright (c) 2018 Manuel Martinez Torres
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+***********************************************************************/
+
+#ifndef MARLIN_KERNELS_HPP
+#define MARLIN_KERNELS_HPP
+
+#include <marlin.h>
+
+#include <vector>
+
+#include "dispatch.hpp"
+
+namespace marlin {
+
+// compress and decompress pick one kernel per dictionary. These lists hold all the
+// kernels that can take its place, so that each one can be checked on any machine
+// (as residualKernels does for the residuals). Kernels of a level above cpuLevel()
+// are listed too, and must be skipped by the caller.
+
+// Encodes the symbols of src as a single Marlin stream, appending the positions of the
+// symbols the dictionary does not hold to unrepresentedSymbols. Returns -1 if dst is too small.
+template<typename TSource, typename MarlinIdx>
+struct EncodeKernel {
+	typedef ssize_t (*EncodeFunction)(const TMarlinCompress<TSource,MarlinIdx> &, View<const TSource>, View<uint8_t>, std::vector<size_t> &);
+
+	const char *name;
+	CpuLevel level;
+	EncodeFunction encode;
+};
+
+template<typename TSource, typename MarlinIdx>
+struct DecodeKernel {
+	const char *name;
+	CpuLevel level;
+	typename TMarlinDecompress<TSource,MarlinIdx>::DecodeFunction decode;
+};
+
+// All encoders, sorted by preference.
+template<typename TSource, typename MarlinIdx>
+std::vector<EncodeKernel<TSource,MarlinIdx>> encodeKernels();
+
+// All decoders able to decode the streams of a dictionary, sorted by preference: its
+// specialized kernel (if there is one), the generic decoder of each level, and then
+// those only worth testing: the non-skip specialized kernel for a skip dictionary, and
+// the slow decoder, which handles any maxWordSize.
+template<typename TSource, typename MarlinIdx>
+std::vector<DecodeKernel<TSource,MarlinIdx>> decodeKernels(size_t K, size_t O, size_t maxWordSize, bool isSkip);
+
+}
+
+#endif /* MARLIN_KERNELS_HPP */
@@ -38,11 +38,114 @@ ssize_t Marlin_compress(const Marlin *dict, uint8_t* dst, size_t dstCapacity, co
 	return dict->compress(marlin::make_view(src,src+srcSize), marlin::make_view(dst,dst+dstCapacity));
 }
 
+ssize_t Marlin_compress_with_workspace(const Marlin *dict, MarlinWorkspace *ws, uint8_t* dst, size_t dstCapacity, const uint8_t* src, size_t srcSize) {
+	
+	return dict->compress(marlin::make_view(src,src+srcSize), marlin::make_view(dst,dst+dstCapacity), *ws);
+}
+
+MarlinWorkspace *Marlin_create_workspace() {
+	return new MarlinWorkspace;
+}
+
+void Marlin_free_workspace(MarlinWorkspace *ws) {
+	
+	if (ws != nullptr)
+		delete ws;
+}
+
 ssize_t Marlin_decompress(const Marlin *dict, uint8_t* dst, size_t dstSize, const uint8_t* src, size_t srcSize) {
 	
 	return dict->decompress(marlin::make_view(src,src+srcSize), marlin::make_view(dst,dst+dstSize));
 }
 
+ssize_t Marlin_compress_parallel(const Marlin *dict, uint8_t* dst, size_t dstCapacity, const uint8_t* src, size_t srcSize, size_t chunkSize, size_t nThreads) {
+	
+	return dict->compressParallel(marlin::make_view(src,src+srcSize), marlin::make_view(dst,dst+dstCapacity), chunkSize, nThreads);
+}
+
+ssize_t Marlin_decompress_parallel(const Marlin *dict, uint8_t* dst, size_t dstSize, const uint8_t* src, size_t srcSize, size_t nThreads) {
+	
+	return dict->decompressParallel(marlin::make_view(src,src+srcSize), marlin::make_view(dst,dst+dstSize), nThreads);
+}
+
+size_t Marlin_compress_parallel_bound(size_t srcSize, size_t chunkSize) {
+	
+	return Marlin::parallelBound(srcSize, chunkSize);
+}
+
+ssize_t Marlin_compress_frame(const Marlin *dict, uint8_t* dst, size_t dstCapacity, const uint8_t* src, size_t srcSize, int checksum) {
+	
+	return dict->compressFrame(marlin::make_view(src,src+srcSize), marlin::make_view(dst,dst+dstCapacity), checksum != 0);
+}
+
+ssize_t Marlin_decompress_frame(const Marlin *dict, uint8_t* dst, size_t dstSize, const uint8_t* src, size_t srcSize) {
+	
+	return dict->decompressFrame(marlin::make_view(src,src+srcSize), marlin::make_view(dst,dst+dstSize));
+}
+
+size_t Marlin_compress_frame_bound(size_t srcSize) {
+	
+	return Marlin::frameBound(srcSize);
+}
+
+ssize_t Marlin_frame_content_size(const uint8_t* src, size_t srcSize) {
+	
+	return Marlin::frameContentSize(marlin::make_view(src,src+srcSize));
+}
+
+MarlinCStream *Marlin_create_cstream(const Marlin *dict, int checksum) {
+	
+	return new MarlinCStream(*dict, checksum != 0);
+}
+
+void Marlin_free_cstream(MarlinCStream *cs) {
+	
+	if (cs != nullptr)
+		delete cs;
+}
+
+ssize_t Marlin_compress_stream(MarlinCStream *cs, uint8_t* dst, size_t dstCapacity, size_t *dstPos, const uint8_t* src, size_t srcSize, size_t *srcPos) {
+	
+	if (*dstPos > dstCapacity or *srcPos > srcSize) return -1;
+	auto in = marlin::make_view(src+*srcPos,src+srcSize);
+	auto out = marlin::make_view(dst+*dstPos,dst+dstCapacity);
+	ssize_t r = cs->compress(in, out);
+	*srcPos = in.start - src;
+	*dstPos = out.start - dst;
+	return r;
+}
+
+ssize_t Marlin_end_stream(MarlinCStream *cs, uint8_t* dst, size_t dstCapacity, size_t *dstPos) {
+	
+	if (*dstPos > dstCapacity) return -1;
+	auto out = marlin::make_view(dst+*dstPos,dst+dstCapacity);
+	ssize_t r = cs->end(out);
+	*dstPos = out.start - dst;
+	return r;
+}
+
+MarlinDStream *Marlin_create_dstream(const Marlin *dict) {
+	
+	return new MarlinDStream(*dict);
+}
+
+void Marlin_free_dstream(MarlinDStream *ds) {
+	
+	if (ds != nullptr)
+		delete ds;
+}
+
+ssize_t Marlin_decompress_stream(MarlinDStream *ds, uint8_t* dst, size_t dstCapacity, size_t *dstPos, const uint8_t* src, size_t srcSize, size_t *srcPos) {
+	
+	if (*dstPos > dstCapacity or *srcPos > srcSize) return -1;
+	auto in = marlin::make_view(src+*srcPos,src+srcSize);
+	auto out = marlin::make_view(dst+*dstPos,dst+dstCapacity);
+	ssize_t r = ds->decompress(in, out);
+	*srcPos = in.start - src;
+	*dstPos = out.start - dst;
+	return r;
+}
+
 Marlin *Marlin_build_dictionary(const char *name, const double hist[256]) {
 	return new Marlin(name,std::vector<double>(&hist[0], &hist[256]));
 }
@@ -53,13 +156,30 @@ void Marlin_free_dictionary(Marlin *dict) {
 		delete dict;
 }
 
-/*const MarlinDictionary **Marlin_get_prebuilt_dictionaries() {
+int Marlin_save_dictionary(const Marlin *dict, const char *path) {
 	
-	return nullptr;
+	return dict->save(path) ? 0 : -1;
 }
 
-const MarlinDictionary * Marlin_estimate_best_dictionary(const MarlinDictionary **dict, const uint8_t* src, size_t srcSize) {
+Marlin *Marlin_load_dictionary(const char *path) {
 	
-	return nullptr;
-}*/
+	return Marlin::load(path).release();
+}
 
+const Marlin * Marlin_estimate_best_dictionary(const Marlin **dict, const uint8_t* src, size_t srcSize) {
+	
+	if (dict == nullptr) return nullptr;
+	
+	auto stats = marlin::blockStats(marlin::make_view(src,src+srcSize));
+	
+	const Marlin *best = nullptr;
+	double bestSize = 0;
+	for (; *dict; dict++) {
+		double sz = (*dict)->estimateSize(stats);
+		if (best == nullptr or sz < bestSize) {
+			best = *dict;
+			bestSize = sz;
+		}
+	}
+	return best;
+}
@@ -0,0 +1,76 @@
+/***********************************************************************
+
+parallel: minimal helpers to spread independent Marlin work across cores
+
+MIT License
+
+Copyright (c) 2018 Manuel Martinez Torres
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+***********************************************************************/
+
+#ifndef MARLIN_PARALLEL_HPP
+#define MARLIN_PARALLEL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace marlin {
+
+/**
+ * Number of workers to use when the caller asks for nThreads (0 means all cores).
+ */
+inline size_t resolveThreads(size_t nThreads, size_t nTasks) {
+
+	if (nThreads == 0) nThreads = std::thread::hardware_concurrency();
+	return std::max(size_t(1), std::min(nThreads, nTasks));
+}
+
+/**
+ * Calls task(i) for every i in [0,nTasks) using up to nThreads workers.
+ *
+ * Workers pull the next pending index from a shared counter, so tasks are
+ * started in ascending order and a slow task does not stall the others.
+ * The calling thread acts as one of the workers.
+ */
+template<typename Task>
+void parallelFor(size_t nTasks, size_t nThreads, Task &&task) {
+
+	nThreads = resolveThreads(nThreads, nTasks);
+
+	std::atomic<size_t> next(0);
+	auto worker = [&]() {
+		for (size_t i = next++; i < nTasks; i = next++)
+			task(i);
+	};
+
+	std::vector<std::thread> threads;
+	for (size_t t=1; t<nThreads; t++)
+		threads.emplace_back(worker);
+	worker();
+	for (auto &&t : threads)
+		t.join();
+}
+
+}
+
+#endif /* MARLIN_PARALLEL_HPP */
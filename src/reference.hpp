@@ -0,0 +1,142 @@
+/***********************************************************************
+
+reference: a straightforward Marlin stream encoder and decoder
+
+MIT License
+
+Copyright (c) 2018 Manuel Martinez Torres
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+***********************************************************************/
+
+#ifndef MARLIN_REFERENCE_HPP
+#define MARLIN_REFERENCE_HPP
+
+#include <marlin.h>
+
+#include <map>
+#include <vector>
+
+namespace marlin {
+
+// Encodes and decodes a single Marlin stream with the words of the dictionary, one
+// symbol and one bit at a time, instead of the compressor and decompressor tables.
+// It is slow, and its only purpose is to check the kernels (see kernels.hpp) against.
+//
+// A stream is the index of each word, of K+O bits, with the first O bits of each index
+// (its chapter) left out, as they are the last O bits of the index before. The first
+// word is in chapter 0. Words are found greedily: a word grows while the dictionary
+// holds it followed by the next symbol, in the same chapter. Symbols that the
+// dictionary can not represent are encoded as the most common one.
+template<typename TSource, typename MarlinIdx>
+class TMarlinReference {
+
+	typedef Word_<MarlinIdx> Word;
+
+	const TMarlinDictionary<TSource,MarlinIdx> &dictionary;
+	const size_t K, O, shift;
+	std::vector<std::map<Word, size_t>> chapters;
+	std::map<size_t, MarlinIdx> source2marlin;
+
+public:
+	// dictionary must outlive the reference.
+	TMarlinReference(const TMarlinDictionary<TSource,MarlinIdx> &dictionary_) :
+		dictionary(dictionary_), K(dictionary.K), O(dictionary.O), shift(dictionary.shift),
+		chapters(size_t(1)<<O) {
+
+		// As in the compressor table, the last of several equal words is the one used.
+		for (size_t i=0; i<dictionary.words.size(); i++)
+			chapters[i>>K][dictionary.words[i]] = i;
+		for (size_t i=0; i<dictionary.marlinAlphabet.size(); i++)
+			source2marlin[dictionary.marlinAlphabet[i].sourceSymbol>>shift] = i;
+	}
+
+	// Returns the stream for src (which must not be empty), and appends the positions of
+	// the symbols that are not represented to unrepresentedSymbols.
+	std::vector<uint8_t> encode(View<const TSource> src, std::vector<size_t> &unrepresentedSymbols) const {
+
+		std::vector<bool> bits;
+		auto marlinSymbol = [&](size_t i) {
+			auto it = source2marlin.find(src.start[i]>>shift);
+			if (it != source2marlin.end()) return it->second;
+			unrepresentedSymbols.push_back(i);
+			return MarlinIdx(0);
+		};
+		auto emit = [&](size_t idx) {
+			for (size_t b=K; b; b--)
+				bits.push_back((idx>>(b-1)) & 1);
+		};
+
+		// The first word is the first one of chapter 0 made of the first symbol.
+		size_t idx = 0;
+		const Word first(1, marlinSymbol(0));
+		while (dictionary.words[idx] != first) idx++;
+
+		for (size_t i=1; i<src.nElements(); i++) {
+
+			MarlinIdx ms = marlinSymbol(i);
+			Word word = dictionary.words[idx];
+			word.push_back(ms);
+
+			auto &&chapter = chapters[idx>>K];
+			auto it = chapter.find(word);
+			if (it != chapter.end() and chapter.at(dictionary.words[idx]) == idx) {
+				idx = it->second;
+			} else {
+				emit(idx);
+				idx = chapters[idx % chapters.size()].at(Word(1, ms));
+			}
+		}
+		emit(idx);
+
+		std::vector<uint8_t> ret((bits.size()+7)/8, 0);
+		for (size_t i=0; i<bits.size(); i++)
+			ret[i/8] |= bits[i] << (7-i%8);
+		return ret;
+	}
+
+	// Decodes words from src until dst is full. Returns false if src ends before.
+	bool decode(View<const uint8_t> src, View<TSource> dst) const {
+
+		// Bit i of the stream, after the O bits of chapter 0.
+		const size_t nBits = O + 8*src.nBytes();
+		auto bit = [&](size_t i) {
+			return i < O ? 0 : (src.start[(i-O)/8] >> (7-(i-O)%8)) & 1;
+		};
+
+		TSource *out = dst.start;
+		for (size_t pos = 0; out < dst.end; pos += K) {
+
+			if (pos + O >= nBits) return false;
+			size_t idx = 0;
+			for (size_t i=pos; i<pos+K+O; i++)
+				idx = (idx<<1) | (i < nBits ? bit(i) : 0);
+
+			for (auto &&ms : dictionary.words[idx])
+				if (out < dst.end)
+					*out++ = dictionary.marlinAlphabet[ms].sourceSymbol;
+		}
+		return true;
+	}
+};
+
+}
+
+#endif /* MARLIN_REFERENCE_HPP */
@@ -0,0 +1,574 @@
+/***********************************************************************
+
+residuals: kernels that store and recover the raw low bits of each symbol
+
+MIT License
+
+Copyright (c) 2018 Manuel Martinez Torres
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+***********************************************************************/
+
+#include "residuals.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <immintrin.h>
+
+using namespace marlin;
+
+namespace {
+
+inline uint64_t load64(const uint8_t *p) { uint64_t v; memcpy(&v, p, sizeof(v)); return v; }
+inline void store64(uint8_t *p, uint64_t v) { memcpy(p, &v, sizeof(v)); }
+
+// Masks with the low n bits set in every lane of 8, 16 and 32 bits.
+struct SwarMasks {
+	uint64_t m8, m16, m32, m64;
+	SwarMasks(size_t shift) :
+		m8 (0x0101010101010101ULL * ((1ULL<<(1*shift))-1)),
+		m16(0x0001000100010001ULL * ((1ULL<<(2*shift))-1)),
+		m32(0x0000000100000001ULL * ((1ULL<<(4*shift))-1)),
+		m64(shift==8 ? ~0ULL : (1ULL<<(8*shift))-1) {}
+};
+
+// Portable version of _pext_u64(x, m8): halves the gaps between lanes three times.
+inline uint64_t swarPack(uint64_t x, const SwarMasks &m, size_t shift) {
+
+	x &= m.m8;
+	x = (x & 0x00FF00FF00FF00FFULL) | ((x & 0xFF00FF00FF00FF00ULL) >> ( 8-1*shift));
+	x = (x & 0x0000FFFF0000FFFFULL) | ((x & 0xFFFF0000FFFF0000ULL) >> (16-2*shift));
+	x = (x & 0x00000000FFFFFFFFULL) | ((x & 0xFFFFFFFF00000000ULL) >> (32-4*shift));
+	return x;
+}
+
+// Portable version of _pdep_u64(x, m8): the inverse of swarPack.
+inline uint64_t swarUnpack(uint64_t x, const SwarMasks &m, size_t shift) {
+
+	x &= m.m64;
+	x = (x & (m.m32 & 0x00000000FFFFFFFFULL)) | ((x << (32-4*shift)) & (m.m32 & 0xFFFFFFFF00000000ULL));
+	x = (x & (m.m16 & 0x0000FFFF0000FFFFULL)) | ((x << (16-2*shift)) & (m.m16 & 0xFFFF0000FFFF0000ULL));
+	x = (x & (m.m8  & 0x00FF00FF00FF00FFULL)) | ((x << ( 8-1*shift)) & (m.m8  & 0xFF00FF00FF00FF00ULL));
+	return x;
+}
+
+// The last groups of a buffer, where an 8 byte access could cross the end of the
+// residual section, go through a local buffer so that no kernel touches memory
+// outside of it.
+inline size_t tailGroups(size_t nGroups, size_t shift) {
+	return std::min(nGroups, (8+shift-1)/shift);
+}
+
+size_t packTail(const uint8_t *src, size_t nGroups, uint8_t *dst, size_t shift, const SwarMasks &m) {
+
+	uint8_t buffer[8*8+8];
+	uint8_t *o8 = buffer;
+	for (size_t g=0; g<nGroups; g++, src += 8, o8 += shift)
+		store64(o8, swarPack(load64(src), m, shift));
+	memcpy(dst, buffer, nGroups*shift);
+	return nGroups*shift;
+}
+
+size_t unpackTail(const uint8_t *src, uint8_t *dst, size_t nGroups, size_t shift, const SwarMasks &m) {
+
+	uint8_t buffer[8*8+8] = {};
+	memcpy(buffer, src, nGroups*shift);
+	const uint8_t *i8 = buffer;
+	for (size_t g=0; g<nGroups; g++, dst += 8, i8 += shift)
+		store64(dst, load64(dst) | swarUnpack(load64(i8), m, shift));
+	return nGroups*shift;
+}
+
+size_t packScalar(const uint8_t *src, size_t nBytes, uint8_t *dst, size_t shift) {
+
+	if (shift == 0) return 0;
+	SwarMasks m(shift);
+
+	const size_t nGroups = nBytes/8;
+	const size_t body = nGroups - tailGroups(nGroups, shift);
+
+	uint8_t *o8 = dst;
+	for (size_t g=0; g<body; g++, src += 8, o8 += shift)
+		store64(o8, swarPack(load64(src), m, shift));
+
+	return (o8 - dst) + packTail(src, nGroups - body, o8, shift, m);
+}
+
+size_t unpackScalar(const uint8_t *src, uint8_t *dst, size_t nBytes, size_t shift) {
+
+	if (shift == 0) return 0;
+	SwarMasks m(shift);
+
+	const size_t nGroups = nBytes/8;
+	const size_t body = nGroups - tailGroups(nGroups, shift);
+
+	const uint8_t *i8 = src;
+	for (size_t g=0; g<body; g++, dst += 8, i8 += shift)
+		store64(dst, load64(dst) | swarUnpack(load64(i8), m, shift));
+
+	return (i8 - src) + unpackTail(i8, dst, nGroups - body, shift, m);
+}
+
+MARLIN_TARGET_BMI2
+size_t packBMI2(const uint8_t *src, size_t nBytes, uint8_t *dst, size_t shift) {
+
+	if (shift == 0) return 0;
+	SwarMasks m(shift);
+
+	const size_t nGroups = nBytes/8;
+	const size_t body = nGroups - tailGroups(nGroups, shift);
+
+	uint8_t *o8 = dst;
+	for (size_t g=0; g<body; g++, src += 8, o8 += shift)
+		store64(o8, _pext_u64(load64(src), m.m8));
+
+	return (o8 - dst) + packTail(src, nGroups - body, o8, shift, m);
+}
+
+MARLIN_TARGET_BMI2
+size_t unpackBMI2(const uint8_t *src, uint8_t *dst, size_t nBytes, size_t shift) {
+
+	if (shift == 0) return 0;
+	SwarMasks m(shift);
+
+	const size_t nGroups = nBytes/8;
+	const size_t body = nGroups - tailGroups(nGroups, shift);
+
+	const uint8_t *i8 = src;
+	for (size_t g=0; g<body; g++, dst += 8, i8 += shift)
+		store64(dst, load64(dst) | _pdep_u64(load64(i8), m.m8));
+
+	return (i8 - src) + unpackTail(i8, dst, nGroups - body, shift, m);
+}
+
+// AVX2 runs the SWAR steps on four groups of 8 bytes at once.
+MARLIN_TARGET_AVX2
+size_t packAVX2(const uint8_t *src, size_t nBytes, uint8_t *dst, size_t shift) {
+
+	if (shift == 0) return 0;
+	SwarMasks m(shift);
+
+	const __m256i m8    = _mm256_set1_epi64x(m.m8);
+	const __m256i lo16  = _mm256_set1_epi64x(0x00FF00FF00FF00FFULL);
+	const __m256i lo32  = _mm256_set1_epi64x(0x0000FFFF0000FFFFULL);
+	const __m256i lo64  = _mm256_set1_epi64x(0x00000000FFFFFFFFULL);
+	const __m128i s16   = _mm_cvtsi32_si128( 8-1*shift);
+	const __m128i s32   = _mm_cvtsi32_si128(16-2*shift);
+	const __m128i s64   = _mm_cvtsi32_si128(32-4*shift);
+
+	const size_t nGroups = nBytes/8;
+	const size_t body = nGroups - tailGroups(nGroups, shift);
+
+	uint8_t *o8 = dst;
+	size_t g = 0;
+	for (; g+4<=body; g+=4, src += 32) {
+		__m256i x = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(src)), m8);
+		x = _mm256_or_si256(_mm256_and_si256(x, lo16), _mm256_srl_epi64(_mm256_andnot_si256(lo16, x), s16));
+		x = _mm256_or_si256(_mm256_and_si256(x, lo32), _mm256_srl_epi64(_mm256_andnot_si256(lo32, x), s32));
+		x = _mm256_or_si256(_mm256_and_si256(x, lo64), _mm256_srl_epi64(_mm256_andnot_si256(lo64, x), s64));
+
+		store64(o8, _mm256_extract_epi64(x, 0)); o8 += shift;
+		store64(o8, _mm256_extract_epi64(x, 1)); o8 += shift;
+		store64(o8, _mm256_extract_epi64(x, 2)); o8 += shift;
+		store64(o8, _mm256_extract_epi64(x, 3)); o8 += shift;
+	}
+	for (; g<body; g++, src += 8, o8 += shift)
+		store64(o8, swarPack(load64(src), m, shift));
+
+	return (o8 - dst) + packTail(src, nGroups - body, o8, shift, m);
+}
+
+MARLIN_TARGET_AVX2
+size_t unpackAVX2(const uint8_t *src, uint8_t *dst, size_t nBytes, size_t shift) {
+
+	if (shift == 0) return 0;
+	SwarMasks m(shift);
+
+	const __m256i m64   = _mm256_set1_epi64x(m.m64);
+	const __m256i m32lo = _mm256_set1_epi64x(m.m32 & 0x00000000FFFFFFFFULL);
+	const __m256i m32hi = _mm256_set1_epi64x(m.m32 & 0xFFFFFFFF00000000ULL);
+	const __m256i m16lo = _mm256_set1_epi64x(m.m16 & 0x0000FFFF0000FFFFULL);
+	const __m256i m16hi = _mm256_set1_epi64x(m.m16 & 0xFFFF0000FFFF0000ULL);
+	const __m256i m8lo  = _mm256_set1_epi64x(m.m8  & 0x00FF00FF00FF00FFULL);
+	const __m256i m8hi  = _mm256_set1_epi64x(m.m8  & 0xFF00FF00FF00FF00ULL);
+	const __m128i s64   = _mm_cvtsi32_si128(32-4*shift);
+	const __m128i s32   = _mm_cvtsi32_si128(16-2*shift);
+	const __m128i s16   = _mm_cvtsi32_si128( 8-1*shift);
+
+	const size_t nGroups = nBytes/8;
+	const size_t body = nGroups - tailGroups(nGroups, shift);
+
+	const uint8_t *i8 = src;
+	size_t g = 0;
+	for (; g+4<=body; g+=4, dst += 32, i8 += 4*shift) {
+		__m256i x = _mm256_set_epi64x(load64(i8+3*shift), load64(i8+2*shift), load64(i8+shift), load64(i8));
+		x = _mm256_and_si256(x, m64);
+		x = _mm256_or_si256(_mm256_and_si256(x, m32lo), _mm256_and_si256(_mm256_sll_epi64(x, s64), m32hi));
+		x = _mm256_or_si256(_mm256_and_si256(x, m16lo), _mm256_and_si256(_mm256_sll_epi64(x, s32), m16hi));
+		x = _mm256_or_si256(_mm256_and_si256(x, m8lo ), _mm256_and_si256(_mm256_sll_epi64(x, s16), m8hi ));
+
+		__m256i *o = reinterpret_cast<__m256i *>(dst);
+		_mm256_storeu_si256(o, _mm256_or_si256(_mm256_loadu_si256(o), x));
+	}
+	for (; g<body; g++, dst += 8, i8 += shift)
+		store64(dst, load64(dst) | swarUnpack(load64(i8), m, shift));
+
+	return (i8 - src) + unpackTail(i8, dst, nGroups - body, shift, m);
+}
+
+// The unmasked AVX-512 shifts and andnot of gcc take _mm512_undefined_epi32() as the
+// source of masked out lanes, which -Wmaybe-uninitialized reports once they are
+// inlined. With every lane selected, the zero masked forms are the same instructions.
+MARLIN_TARGET_AVX512 inline __m512i srl512(__m512i x, __m128i s) { return _mm512_maskz_srl_epi64(0xFF, x, s); }
+MARLIN_TARGET_AVX512 inline __m512i sll512(__m512i x, __m128i s) { return _mm512_maskz_sll_epi64(0xFF, x, s); }
+MARLIN_TARGET_AVX512 inline __m512i andnot512(__m512i a, __m512i b) { return _mm512_maskz_andnot_epi64(0xFF, a, b); }
+
+// AVX-512 does the same on eight groups.
+MARLIN_TARGET_AVX512
+size_t packAVX512(const uint8_t *src, size_t nBytes, uint8_t *dst, size_t shift) {
+
+	if (shift == 0) return 0;
+	SwarMasks m(shift);
+
+	const __m512i m8    = _mm512_set1_epi64(m.m8);
+	const __m512i lo16  = _mm512_set1_epi64(0x00FF00FF00FF00FFULL);
+	const __m512i lo32  = _mm512_set1_epi64(0x0000FFFF0000FFFFULL);
+	const __m512i lo64  = _mm512_set1_epi64(0x00000000FFFFFFFFULL);
+	const __m128i s16   = _mm_cvtsi32_si128( 8-1*shift);
+	const __m128i s32   = _mm_cvtsi32_si128(16-2*shift);
+	const __m128i s64   = _mm_cvtsi32_si128(32-4*shift);
+
+	const size_t nGroups = nBytes/8;
+	const size_t body = nGroups - tailGroups(nGroups, shift);
+
+	uint8_t *o8 = dst;
+	size_t g = 0;
+	for (; g+8<=body; g+=8, src += 64) {
+		__m512i x = _mm512_and_si512(_mm512_loadu_si512(src), m8);
+		x = _mm512_or_si512(_mm512_and_si512(x, lo16), srl512(andnot512(lo16, x), s16));
+		x = _mm512_or_si512(_mm512_and_si512(x, lo32), srl512(andnot512(lo32, x), s32));
+		x = _mm512_or_si512(_mm512_and_si512(x, lo64), srl512(andnot512(lo64, x), s64));
+
+		uint64_t lanes[8];
+		_mm512_storeu_si512(lanes, x);
+		for (size_t l=0; l<8; l++, o8 += shift)
+			store64(o8, lanes[l]);
+	}
+	for (; g<body; g++, src += 8, o8 += shift)
+		store64(o8, swarPack(load64(src), m, shift));
+
+	return (o8 - dst) + packTail(src, nGroups - body, o8, shift, m);
+}
+
+MARLIN_TARGET_AVX512
+size_t unpackAVX512(const uint8_t *src, uint8_t *dst, size_t nBytes, size_t shift) {
+
+	if (shift == 0) return 0;
+	SwarMasks m(shift);
+
+	const __m512i m64   = _mm512_set1_epi64(m.m64);
+	const __m512i m32lo = _mm512_set1_epi64(m.m32 & 0x00000000FFFFFFFFULL);
+	const __m512i m32hi = _mm512_set1_epi64(m.m32 & 0xFFFFFFFF00000000ULL);
+	const __m512i m16lo = _mm512_set1_epi64(m.m16 & 0x0000FFFF0000FFFFULL);
+	const __m512i m16hi = _mm512_set1_epi64(m.m16 & 0xFFFF0000FFFF0000ULL);
+	const __m512i m8lo  = _mm512_set1_epi64(m.m8  & 0x00FF00FF00FF00FFULL);
+	const __m512i m8hi  = _mm512_set1_epi64(m.m8  & 0xFF00FF00FF00FF00ULL);
+	const __m128i s64   = _mm_cvtsi32_si128(32-4*shift);
+	const __m128i s32   = _mm_cvtsi32_si128(16-2*shift);
+	const __m128i s16   = _mm_cvtsi32_si128( 8-1*shift);
+
+	const size_t nGroups = nBytes/8;
+	const size_t body = nGroups - tailGroups(nGroups, shift);
+
+	const uint8_t *i8 = src;
+	size_t g = 0;
+	for (; g+8<=body; g+=8, dst += 64, i8 += 8*shift) {
+		__m512i x = _mm512_set_epi64(
+			load64(i8+7*shift), load64(i8+6*shift), load64(i8+5*shift), load64(i8+4*shift),
+			load64(i8+3*shift), load64(i8+2*shift), load64(i8+1*shift), load64(i8));
+		x = _mm512_and_si512(x, m64);
+		x = _mm512_or_si512(_mm512_and_si512(x, m32lo), _mm512_and_si512(sll512(x, s64), m32hi));
+		x = _mm512_or_si512(_mm512_and_si512(x, m16lo), _mm512_and_si512(sll512(x, s32), m16hi));
+		x = _mm512_or_si512(_mm512_and_si512(x, m8lo ), _mm512_and_si512(sll512(x, s16), m8hi ));
+
+		_mm512_storeu_si512(dst, _mm512_or_si512(_mm512_loadu_si512(dst), x));
+	}
+	for (; g<body; g++, dst += 8, i8 += shift)
+		store64(dst, load64(dst) | swarUnpack(load64(i8), m, shift));
+
+	return (i8 - src) + unpackTail(i8, dst, nGroups - body, shift, m);
+}
+
+////////////////////////////////////////////////////////////////////////
+//
+// 16 bit symbols
+
+// Masks with the low shift bits set in every lane of 16 bits, the low 2*shift bits in
+// every lane of 32 bits, and the low 4*shift bits that 4 symbols pack into.
+struct SwarMasks16 {
+	uint64_t m16, m32, m64;
+	SwarMasks16(size_t shift) :
+		m16(0x0001000100010001ULL * ((1ULL<<(1*shift))-1)),
+		m32(0x0000000100000001ULL * ((1ULL<<(2*shift))-1)),
+		m64((1ULL<<(4*shift))-1) {}
+};
+
+// Portable version of _pext_u64(x, m16): halves the gaps between lanes twice.
+inline uint64_t swarPack16(uint64_t x, const SwarMasks16 &m, size_t shift) {
+
+	x &= m.m16;
+	x = (x & 0x0000FFFF0000FFFFULL) | ((x & 0xFFFF0000FFFF0000ULL) >> (16-1*shift));
+	x = (x & 0x00000000FFFFFFFFULL) | ((x & 0xFFFFFFFF00000000ULL) >> (32-2*shift));
+	return x;
+}
+
+// Portable version of _pdep_u64(x, m16): the inverse of swarPack16.
+inline uint64_t swarUnpack16(uint64_t x, const SwarMasks16 &m, size_t shift) {
+
+	x &= m.m64;
+	x = (x & (m.m32 & 0x00000000FFFFFFFFULL)) | ((x << (32-2*shift)) & (m.m32 & 0xFFFFFFFF00000000ULL));
+	x = (x & (m.m16 & 0x0000FFFF0000FFFFULL)) | ((x << (16-1*shift)) & (m.m16 & 0xFFFF0000FFFF0000ULL));
+	return x;
+}
+
+// A group of 8 symbols is two lanes of 64 bits: lo packs symbols 0-3 and hi symbols 4-7,
+// each into 4*shift bits. Groups are accessed with 16 bytes, of which shift are theirs.
+inline void storeGroup16(uint8_t *p, uint64_t lo, uint64_t hi, size_t shift) {
+
+	store64(p, lo | (hi << (4*shift)));
+	store64(p+8, hi >> (64-4*shift));
+}
+
+// Bits above the 4*shift of each lane are left for the caller to mask.
+inline void loadGroup16(const uint8_t *p, uint64_t &lo, uint64_t &hi, size_t shift) {
+
+	uint64_t a = load64(p), b = load64(p+8);
+	lo = a;
+	hi = (a >> (4*shift)) | (b << (64-4*shift));
+}
+
+inline void orGroup16(uint16_t *dst, uint64_t lo, uint64_t hi) {
+
+	uint8_t *d = reinterpret_cast<uint8_t *>(dst);
+	store64(d,   load64(d)   | lo);
+	store64(d+8, load64(d+8) | hi);
+}
+
+inline size_t tailGroups16(size_t nGroups, size_t shift) {
+	return std::min(nGroups, (16+shift-1)/shift);
+}
+
+size_t packTail16(const uint16_t *src, size_t nGroups, uint8_t *dst, size_t shift, const SwarMasks16 &m) {
+
+	uint8_t buffer[16*4+16];
+	uint8_t *o8 = buffer;
+	for (size_t g=0; g<nGroups; g++, src += 8, o8 += shift)
+		storeGroup16(o8, 
+			swarPack16(load64(reinterpret_cast<const uint8_t *>(src)), m, shift), 
+			swarPack16(load64(reinterpret_cast<const uint8_t *>(src+4)), m, shift), shift);
+	memcpy(dst, buffer, nGroups*shift);
+	return nGroups*shift;
+}
+
+size_t unpackTail16(const uint8_t *src, uint16_t *dst, size_t nGroups, size_t shift, const SwarMasks16 &m) {
+
+	uint8_t buffer[16*4+16] = {};
+	memcpy(buffer, src, nGroups*shift);
+	const uint8_t *i8 = buffer;
+	for (size_t g=0; g<nGroups; g++, dst += 8, i8 += shift) {
+		uint64_t lo, hi;
+		loadGroup16(i8, lo, hi, shift);
+		orGroup16(dst, swarUnpack16(lo, m, shift), swarUnpack16(hi, m, shift));
+	}
+	return nGroups*shift;
+}
+
+size_t packScalar16(const uint16_t *src, size_t nElements, uint8_t *dst, size_t shift) {
+
+	if (shift == 0) return 0;
+	SwarMasks16 m(shift);
+
+	const size_t nGroups = nElements/8;
+	const size_t body = nGroups - tailGroups16(nGroups, shift);
+
+	uint8_t *o8 = dst;
+	for (size_t g=0; g<body; g++, src += 8, o8 += shift)
+		storeGroup16(o8, 
+			swarPack16(load64(reinterpret_cast<const uint8_t *>(src)), m, shift), 
+			swarPack16(load64(reinterpret_cast<const uint8_t *>(src+4)), m, shift), shift);
+
+	return (o8 - dst) + packTail16(src, nGroups - body, o8, shift, m);
+}
+
+size_t unpackScalar16(const uint8_t *src, uint16_t *dst, size_t nElements, size_t shift) {
+
+	if (shift == 0) return 0;
+	SwarMasks16 m(shift);
+
+	const size_t nGroups = nElements/8;
+	const size_t body = nGroups - tailGroups16(nGroups, shift);
+
+	const uint8_t *i8 = src;
+	for (size_t g=0; g<body; g++, dst += 8, i8 += shift) {
+		uint64_t lo, hi;
+		loadGroup16(i8, lo, hi, shift);
+		orGroup16(dst, swarUnpack16(lo, m, shift), swarUnpack16(hi, m, shift));
+	}
+
+	return (i8 - src) + unpackTail16(i8, dst, nGroups - body, shift, m);
+}
+
+MARLIN_TARGET_BMI2
+size_t packBMI216(const uint16_t *src, size_t nElements, uint8_t *dst, size_t shift) {
+
+	if (shift == 0) return 0;
+	SwarMasks16 m(shift);
+
+	const size_t nGroups = nElements/8;
+	const size_t body = nGroups - tailGroups16(nGroups, shift);
+
+	uint8_t *o8 = dst;
+	for (size_t g=0; g<body; g++, src += 8, o8 += shift)
+		storeGroup16(o8, 
+			_pext_u64(load64(reinterpret_cast<const uint8_t *>(src)), m.m16), 
+			_pext_u64(load64(reinterpret_cast<const uint8_t *>(src+4)), m.m16), shift);
+
+	return (o8 - dst) + packTail16(src, nGroups - body, o8, shift, m);
+}
+
+MARLIN_TARGET_BMI2
+size_t unpackBMI216(const uint8_t *src, uint16_t *dst, size_t nElements, size_t shift) {
+
+	if (shift == 0) return 0;
+	SwarMasks16 m(shift);
+
+	const size_t nGroups = nElements/8;
+	const size_t body = nGroups - tailGroups16(nGroups, shift);
+
+	const uint8_t *i8 = src;
+	for (size_t g=0; g<body; g++, dst += 8, i8 += shift) {
+		uint64_t lo, hi;
+		loadGroup16(i8, lo, hi, shift);
+		orGroup16(dst, _pdep_u64(lo, m.m16), _pdep_u64(hi, m.m16));
+	}
+
+	return (i8 - src) + unpackTail16(i8, dst, nGroups - body, shift, m);
+}
+
+// AVX2 runs the SWAR steps on two groups at once. The lanes of a group are joined in
+// scalar code, so wider registers would not help: AVX-512 uses these too.
+MARLIN_TARGET_AVX2
+size_t packAVX216(const uint16_t *src, size_t nElements, uint8_t *dst, size_t shift) {
+
+	if (shift == 0) return 0;
+	SwarMasks16 m(shift);
+
+	const __m256i m16   = _mm256_set1_epi64x(m.m16);
+	const __m256i lo32  = _mm256_set1_epi64x(0x0000FFFF0000FFFFULL);
+	const __m256i lo64  = _mm256_set1_epi64x(0x00000000FFFFFFFFULL);
+	const __m128i s32   = _mm_cvtsi32_si128(16-1*shift);
+	const __m128i s64   = _mm_cvtsi32_si128(32-2*shift);
+
+	const size_t nGroups = nElements/8;
+	const size_t body = nGroups - tailGroups16(nGroups, shift);
+
+	uint8_t *o8 = dst;
+	size_t g = 0;
+	for (; g+2<=body; g+=2, src += 16) {
+		__m256i x = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(src)), m16);
+		x = _mm256_or_si256(_mm256_and_si256(x, lo32), _mm256_srl_epi64(_mm256_andnot_si256(lo32, x), s32));
+		x = _mm256_or_si256(_mm256_and_si256(x, lo64), _mm256_srl_epi64(_mm256_andnot_si256(lo64, x), s64));
+
+		storeGroup16(o8, _mm256_extract_epi64(x, 0), _mm256_extract_epi64(x, 1), shift); o8 += shift;
+		storeGroup16(o8, _mm256_extract_epi64(x, 2), _mm256_extract_epi64(x, 3), shift); o8 += shift;
+	}
+	for (; g<body; g++, src += 8, o8 += shift)
+		storeGroup16(o8, 
+			swarPack16(load64(reinterpret_cast<const uint8_t *>(src)), m, shift), 
+			swarPack16(load64(reinterpret_cast<const uint8_t *>(src+4)), m, shift), shift);
+
+	return (o8 - dst) + packTail16(src, nGroups - body, o8, shift, m);
+}
+
+MARLIN_TARGET_AVX2
+size_t unpackAVX216(const uint8_t *src, uint16_t *dst, size_t nElements, size_t shift) {
+
+	if (shift == 0) return 0;
+	SwarMasks16 m(shift);
+
+	const __m256i m64   = _mm256_set1_epi64x(m.m64);
+	const __m256i m32lo = _mm256_set1_epi64x(m.m32 & 0x00000000FFFFFFFFULL);
+	const __m256i m32hi = _mm256_set1_epi64x(m.m32 & 0xFFFFFFFF00000000ULL);
+	const __m256i m16lo = _mm256_set1_epi64x(m.m16 & 0x0000FFFF0000FFFFULL);
+	const __m256i m16hi = _mm256_set1_epi64x(m.m16 & 0xFFFF0000FFFF0000ULL);
+	const __m128i s64   = _mm_cvtsi32_si128(32-2*shift);
+	const __m128i s32   = _mm_cvtsi32_si128(16-1*shift);
+
+	const size_t nGroups = nElements/8;
+	const size_t body = nGroups - tailGroups16(nGroups, shift);
+
+	const uint8_t *i8 = src;
+	size_t g = 0;
+	for (; g+2<=body; g+=2, dst += 16, i8 += 2*shift) {
+		uint64_t lo0, hi0, lo1, hi1;
+		loadGroup16(i8, lo0, hi0, shift);
+		loadGroup16(i8+shift, lo1, hi1, shift);
+		__m256i x = _mm256_set_epi64x(hi1, lo1, hi0, lo0);
+		x = _mm256_and_si256(x, m64);
+		x = _mm256_or_si256(_mm256_and_si256(x, m32lo), _mm256_and_si256(_mm256_sll_epi64(x, s64), m32hi));
+		x = _mm256_or_si256(_mm256_and_si256(x, m16lo), _mm256_and_si256(_mm256_sll_epi64(x, s32), m16hi));
+
+		__m256i *o = reinterpret_cast<__m256i *>(dst);
+		_mm256_storeu_si256(o, _mm256_or_si256(_mm256_loadu_si256(o), x));
+	}
+	for (; g<body; g++, dst += 8, i8 += shift) {
+		uint64_t lo, hi;
+		loadGroup16(i8, lo, hi, shift);
+		orGroup16(dst, swarUnpack16(lo, m, shift), swarUnpack16(hi, m, shift));
+	}
+
+	return (i8 - src) + unpackTail16(i8, dst, nGroups - body, shift, m);
+}
+
+// Sorted by preference: pdep/pext are microcoded on some AMD cores, so AVX2 goes before BMI2.
+const ResidualKernel kernels[] = {
+	{ "avx512", CpuLevel::AVX512, &packAVX512, &unpackAVX512, &packAVX216,   &unpackAVX216   },
+	{ "avx2",   CpuLevel::AVX2,   &packAVX2,   &unpackAVX2,   &packAVX216,   &unpackAVX216   },
+	{ "bmi2",   CpuLevel::BMI2,   &packBMI2,   &unpackBMI2,   &packBMI216,   &unpackBMI216   },
+	{ "scalar", CpuLevel::Scalar, &packScalar, &unpackScalar, &packScalar16, &unpackScalar16 },
+	{ nullptr,  CpuLevel::Scalar, nullptr,     nullptr,       nullptr,       nullptr         },
+};
+
+}
+
+const ResidualKernel *marlin::residualKernels() {
+
+	return kernels;
+}
+
+const ResidualKernel &marlin::bestResidualKernel() {
+
+	static const ResidualKernel &best = []() -> const ResidualKernel & {
+		const ResidualKernel *k = kernels;
+		while (not cpuSupports(k->level)) k++;
+		return *k;
+	}();
+	return best;
+}
@@ -0,0 +1,86 @@
+/***********************************************************************
+
+residuals: kernels that store and recover the raw low bits of each symbol
+
+MIT License
+
+Copyright (c) 2018 Manuel Martinez Torres
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+***********************************************************************/
+
+#ifndef MARLIN_RESIDUALS_HPP
+#define MARLIN_RESIDUALS_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "dispatch.hpp"
+
+namespace marlin {
+
+// Every group of 8 bytes contributes its 8*shift low bits, packed as a little endian
+// integer where byte k lands at bit k*shift (this is what _pext_u64 produces).
+
+// Packs the low shift bits of src[0..nBytes) (nBytes multiple of 8) into dst.
+// Returns the number of bytes written, which is exactly nBytes*shift/8.
+typedef size_t (*PackResidualsFunction)(const uint8_t *src, size_t nBytes, uint8_t *dst, size_t shift);
+
+// ORs the residuals stored in src into the low shift bits of dst[0..nBytes).
+// Reads exactly nBytes*shift/8 bytes from src.
+typedef size_t (*UnpackResidualsFunction)(const uint8_t *src, uint8_t *dst, size_t nBytes, size_t shift);
+
+// 16 bit symbols are taken in groups of 8, which contribute their 8*shift low bits with
+// symbol k at bit k*shift. nElements is a multiple of 8 and shift is at most 15.
+typedef size_t (*PackResiduals16Function)(const uint16_t *src, size_t nElements, uint8_t *dst, size_t shift);
+typedef size_t (*UnpackResiduals16Function)(const uint8_t *src, uint16_t *dst, size_t nElements, size_t shift);
+
+struct ResidualKernel {
+	const char *name;
+	CpuLevel level;
+	PackResidualsFunction pack;
+	UnpackResidualsFunction unpack;
+	PackResiduals16Function pack16;
+	UnpackResiduals16Function unpack16;
+};
+
+// All residual kernels, ending with a kernel whose name is nullptr.
+const ResidualKernel *residualKernels();
+
+// Fastest kernel supported by the running CPU (see cpuLevel).
+const ResidualKernel &bestResidualKernel();
+
+// Residuals of a block of symbols of either size, with the fastest kernel.
+inline size_t packResiduals(const uint8_t *src, size_t nElements, uint8_t *dst, size_t shift) {
+	return bestResidualKernel().pack(src, nElements, dst, shift);
+}
+inline size_t packResiduals(const uint16_t *src, size_t nElements, uint8_t *dst, size_t shift) {
+	return bestResidualKernel().pack16(src, nElements, dst, shift);
+}
+inline size_t unpackResiduals(const uint8_t *src, uint8_t *dst, size_t nElements, size_t shift) {
+	return bestResidualKernel().unpack(src, dst, nElements, shift);
+}
+inline size_t unpackResiduals(const uint8_t *src, uint16_t *dst, size_t nElements, size_t shift) {
+	return bestResidualKernel().unpack16(src, dst, nElements, shift);
+}
+
+}
+
+#endif /* MARLIN_RESIDUALS_HPP */
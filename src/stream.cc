@@ -0,0 +1,296 @@
+/***********************************************************************
+
+stream: incremental compression and decompression of frames with bounded memory
+
+MIT License
+
+Copyright (c) 2017 Manuel Martinez Torres
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+***********************************************************************/
+
+#include <marlin.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "checksum.hpp"
+#include "frame.hpp"
+
+using namespace marlin;
+
+namespace {
+
+constexpr size_t ENTRY_SIZE = 2*sizeof(uint32_t);
+
+}
+
+////////////////////////////////////////////////////////////////////////
+//
+// Compression
+
+template<typename TSource, typename MarlinIdx>
+TMarlinCStream<TSource,MarlinIdx>::TMarlinCStream(const Dictionary &dictionary_, bool checksum_, size_t blockSize_) :
+	dictionary(dictionary_),
+	checksum(checksum_),
+	blockSize(std::min(blockSize_ ? blockSize_ : FRAME_DEFAULT_BLOCK_SIZE, size_t(MAX_BLOCK_SIZE))),
+	hash(new XXHash64) {
+	
+	// At most the header, one block and the end of the frame are ever pending.
+	input.reserve(blockSize);
+	pending.reserve(sizeof(FrameHeader) + 2*ENTRY_SIZE + blockSize*sizeof(TSource) + sizeof(uint64_t));
+}
+
+template<typename TSource, typename MarlinIdx>
+TMarlinCStream<TSource,MarlinIdx>::~TMarlinCStream() {}
+
+template<typename TSource, typename MarlinIdx>
+void TMarlinCStream<TSource,MarlinIdx>::start() {
+	
+	FrameHeader header = makeFrameHeader(
+		FRAME_FLAG_STREAMED | (checksum ? FRAME_FLAG_CHECKSUM : 0), sizeof(TSource), dictionary.id, blockSize, 0);
+	pending.resize(pending.size() + sizeof(FrameHeader));
+	writeFrameHeader(header, &pending[pending.size() - sizeof(FrameHeader)]);
+	
+	*hash = XXHash64();
+	started = true;
+	ended = false;
+}
+
+template<typename TSource, typename MarlinIdx>
+size_t TMarlinCStream<TSource,MarlinIdx>::flush(View<uint8_t> &dst) {
+	
+	size_t n = std::min(pending.size() - pendingPos, dst.nBytes());
+	memcpy(dst.start, pending.data() + pendingPos, n);
+	dst.start += n;
+	pendingPos += n;
+	
+	if (pendingPos == pending.size()) {
+		pending.clear();
+		pendingPos = 0;
+	}
+	return pending.size() - pendingPos;
+}
+
+template<typename TSource, typename MarlinIdx>
+ssize_t TMarlinCStream<TSource,MarlinIdx>::encodeBlock(View<const TSource> block, View<uint8_t> &dst) {
+	
+	// Straight into dst when nothing is waiting before it and the block surely fits.
+	const size_t bound = ENTRY_SIZE + block.nBytes();
+	const bool direct = pending.empty() and dst.nBytes() >= bound;
+	
+	const size_t offset = pending.size();
+	if (not direct) pending.resize(offset + bound);
+	uint8_t *out = direct ? dst.start : &pending[offset];
+	
+	ssize_t r = dictionary.compress(block, marlin::make_view(out + ENTRY_SIZE, out + bound), workspace);
+	if (r < 0) return -1;
+	
+	storeLE32(out, block.nElements());
+	storeLE32(out + sizeof(uint32_t), r);
+	if (checksum) hash->update(block.start, block.nBytes());
+	
+	if (direct)
+		dst.start += ENTRY_SIZE + r;
+	else
+		pending.resize(offset + ENTRY_SIZE + r);
+	return 0;
+}
+
+template<typename TSource, typename MarlinIdx>
+ssize_t TMarlinCStream<TSource,MarlinIdx>::compress(View<const TSource> &src, View<uint8_t> &dst) {
+	
+	if (ended) {
+		if (flush(dst)) return 0;
+		started = false;
+	}
+	if (not started) start();
+	
+	while (true) {
+		
+		if (flush(dst) or src.nElements() == 0) return 0;
+		
+		if (input.empty() and src.nElements() >= blockSize) {
+			if (encodeBlock(marlin::make_view(src.start, src.start + blockSize), dst) < 0) return -1;
+			src.start += blockSize;
+			continue;
+		}
+		
+		size_t n = std::min(blockSize - input.size(), src.nElements());
+		input.insert(input.end(), src.start, src.start + n);
+		src.start += n;
+		
+		if (input.size() == blockSize) {
+			if (encodeBlock(View<const TSource>(input.data(), input.data() + input.size()), dst) < 0) return -1;
+			input.clear();
+		}
+	}
+}
+
+template<typename TSource, typename MarlinIdx>
+ssize_t TMarlinCStream<TSource,MarlinIdx>::end(View<uint8_t> &dst) {
+	
+	if (not started) start();
+	
+	if (not ended) {
+		flush(dst);
+		if (not input.empty()) {
+			if (encodeBlock(View<const TSource>(input.data(), input.data() + input.size()), dst) < 0) return -1;
+			input.clear();
+		}
+		
+		// The end entry is all zeros.
+		pending.resize(pending.size() + ENTRY_SIZE, 0);
+		if (checksum) {
+			pending.resize(pending.size() + sizeof(uint64_t));
+			storeLE64(&pending[pending.size() - sizeof(uint64_t)], hash->digest());
+		}
+		ended = true;
+	}
+	return flush(dst);
+}
+
+////////////////////////////////////////////////////////////////////////
+//
+// Decompression
+
+template<typename TSource, typename MarlinIdx>
+TMarlinDStream<TSource,MarlinIdx>::TMarlinDStream(const Dictionary &dictionary_) :
+	dictionary(dictionary_),
+	needed(sizeof(FrameHeader)),
+	hash(new XXHash64) {}
+
+template<typename TSource, typename MarlinIdx>
+TMarlinDStream<TSource,MarlinIdx>::~TMarlinDStream() {}
+
+template<typename TSource, typename MarlinIdx>
+const uint8_t *TMarlinDStream<TSource,MarlinIdx>::take(View<const uint8_t> &src) {
+	
+	// Straight from src when the whole stage is there.
+	if (input.empty() and src.nBytes() >= needed) {
+		const uint8_t *ret = src.start;
+		src.start += needed;
+		return ret;
+	}
+	
+	size_t n = std::min(needed - input.size(), src.nBytes());
+	input.insert(input.end(), src.start, src.start + n);
+	src.start += n;
+	return input.size() == needed ? input.data() : nullptr;
+}
+
+template<typename TSource, typename MarlinIdx>
+bool TMarlinDStream<TSource,MarlinIdx>::step(const uint8_t *data, View<TSource> &dst) {
+	
+	switch (stage) {
+	case Stage::Header: {
+		FrameHeader header;
+		if (not readFrameHeader<TSource>(marlin::make_view(data, data + sizeof(FrameHeader)), header)) return false;
+		if (not (header.flags & FRAME_FLAG_STREAMED) or header.dictionaryId != dictionary.id) return false;
+		if (header.blockSize > TMarlinCStream<TSource,MarlinIdx>::MAX_BLOCK_SIZE) return false;
+		
+		checksum = header.flags & FRAME_FLAG_CHECKSUM;
+		blockSize = header.blockSize;
+		*hash = XXHash64();
+		stage = Stage::Entry;
+		needed = ENTRY_SIZE;
+		return true;
+	}
+	case Stage::Entry: {
+		const uint32_t entry[2] = { loadLE32(data), loadLE32(data + sizeof(uint32_t)) };
+		if (entry[0] == 0) {
+			if (entry[1] != 0) return false;
+			stage = checksum ? Stage::Checksum : Stage::Done;
+			needed = checksum ? sizeof(uint64_t) : sizeof(FrameHeader);
+			return true;
+		}
+		// A Marlin block is never larger than its symbols stored raw.
+		if (entry[0] > blockSize or entry[1] == 0 or entry[1] > entry[0]*sizeof(TSource)) return false;
+		
+		blockElements = entry[0];
+		stage = Stage::Block;
+		needed = entry[1];
+		return true;
+	}
+	case Stage::Block: {
+		// Straight into dst when it has room for the whole block.
+		const bool direct = dst.nElements() >= blockElements;
+		if (not direct) output.resize(blockElements);
+		TSource *out = direct ? dst.start : output.data();
+		
+		if (dictionary.decompress(marlin::make_view(data, data + needed), marlin::make_view(out, out + blockElements)) != ssize_t(blockElements)) return false;
+		if (checksum) hash->update(out, blockElements*sizeof(TSource));
+		if (direct) dst.start += blockElements;
+		
+		stage = Stage::Entry;
+		needed = ENTRY_SIZE;
+		return true;
+	}
+	case Stage::Checksum: {
+		if (loadLE64(data) != hash->digest()) return false;
+		stage = Stage::Done;
+		needed = sizeof(FrameHeader);
+		return true;
+	}
+	case Stage::Done:
+	case Stage::Error:
+		break;
+	}
+	return false;
+}
+
+template<typename TSource, typename MarlinIdx>
+ssize_t TMarlinDStream<TSource,MarlinIdx>::decompress(View<const uint8_t> &src, View<TSource> &dst) {
+	
+	// A new frame starts only once the previous one has been reported complete.
+	if (stage == Stage::Done and src.nBytes()) stage = Stage::Header;
+	
+	while (true) {
+		
+		// Symbols decoded earlier go first.
+		size_t n = std::min(output.size() - outputPos, dst.nElements());
+		std::copy_n(output.data() + outputPos, n, dst.start);
+		dst.start += n;
+		outputPos += n;
+		if (outputPos < output.size()) return 1;
+		output.clear();
+		outputPos = 0;
+		
+		if (stage == Stage::Error) return -1;
+		if (stage == Stage::Done) return 0;
+		
+		const uint8_t *data = take(src);
+		if (data == nullptr) return 1;
+		
+		bool ok = step(data, dst);
+		input.clear();
+		if (not ok) {
+			stage = Stage::Error;
+			return -1;
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////////////////
+//
+// Explicit Instantiations
+#include "instantiations.h"
+INSTANTIATE(TMarlinCStream)
+INSTANTIATE(TMarlinDStream)
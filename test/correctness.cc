@@ -1,6 +1,9 @@
 #include "marlin.h"
 #include "../src/distribution.hpp"
+#include "../src/residuals.hpp"
+#include "../src/checksum.hpp"
 #include <iostream>
+#include <cstring>
 
 static void printAlpha(std::vector<uint8_t> msg) {
 	for (size_t i=0; i<msg.size(); i++) {
@@ -123,11 +126,804 @@ static bool testLaplace() {
 	return true;
 }
 
+static bool testParallel() {
+	
+	std::cout << "Test Parallel" << std::endl;
+
+	size_t sz = (1<<20) + 123;
+	
+	Marlin dict("",Distribution::pdf(256, Distribution::Laplace, 0.3));
+	
+	std::vector<uint8_t> original(Distribution::getResiduals(Distribution::pdf(Distribution::Laplace, 0.3),sz));
+	std::vector<uint8_t> compressed1(Marlin::parallelBound(sz, 1<<16));
+	std::vector<uint8_t> compressed4(Marlin::parallelBound(sz, 1<<16));
+	std::vector<uint8_t> uncompressed(sz);
+	
+	if (dict.compressParallel(original, compressed1, 1<<16, 1) < 0) return false;
+	if (dict.compressParallel(original, compressed4, 1<<16, 4) < 0) return false;
+	
+	std::cout << "Compressed Size: " << compressed4.size() << std::endl;
+
+	// The frame must not depend on the number of workers.
+	if (compressed1 != compressed4) {
+		std::cout << "FAIL! frame depends on the number of threads" << std::endl;
+		return false;
+	}
+	
+	if (dict.decompressParallel(compressed4, uncompressed, 4) != ssize_t(sz) or original != uncompressed) {
+		std::cout << "FAIL! parallel roundtrip" << std::endl;
+		return false;
+	}
+	
+	std::cout << "Original == uncompressed!" << std::endl;
+	return true;
+}
+
+static bool testDecoders() {
+	
+	std::cout << "Test Decoders" << std::endl;
+	
+	auto roundtrip = [](const Marlin &dict, double p) {
+		
+		for (size_t sz : {1000, (1<<16)+5}) {
+			
+			std::vector<uint8_t> original(Distribution::getResiduals(Distribution::pdf(Distribution::Laplace, p),sz));
+			std::vector<uint8_t> compressed(sz);
+			// Not zeroed: the decoders must write every symbol, including the runs of the
+			// most common one (zero here) that follow long words.
+			std::vector<uint8_t> uncompressed(sz, 0x55);
+			
+			if (dict.compress(original, compressed) < 0 or dict.decompress(compressed, uncompressed) != ssize_t(sz) or
+				original != uncompressed) {
+				
+				std::cout << "FAIL! K: " << dict.K << " O: " << dict.O << " maxWordSize: " << dict.maxWordSize << " p: " << p << " size: " << sz << std::endl;
+				return false;
+			}
+		}
+		return true;
+	};
+	
+	// Specialized kernels, then configurations left to the generic decoders: an odd K
+	// above 8, an O above 4 and a maxWordSize that is not a power of two minus one.
+	const size_t configurations[][3] = { {8,4,15}, {8,4,31}, {7,2,3}, {4,0,63}, {9,3,7}, {8,5,7}, {8,4,5} };
+	for (auto &&c : configurations) {
+		
+		marlin::Configuration conf;
+		conf["K"] = c[0];
+		conf["O"] = c[1];
+		conf["maxWordSize"] = c[2];
+		Marlin dict("",Distribution::pdf(256, Distribution::Laplace, 0.5), conf);
+		if (not roundtrip(dict, 0.5)) return false;
+	}
+	
+	// Sparse sources get non-skip dictionaries with words of dozens of symbols.
+	for (size_t maxWordSize : {3, 7, 15, 5}) {
+		
+		marlin::Configuration conf;
+		conf["maxWordSize"] = maxWordSize;
+		Marlin dict("",Distribution::pdf(256, Distribution::Laplace, 0.05), conf);
+		if (dict.isSkip or not roundtrip(dict, 0.05)) return false;
+	}
+	
+	std::cout << "Original == uncompressed!" << std::endl;
+	return true;
+}
+
+static bool testWorkspace() {
+	
+	std::cout << "Test Workspace" << std::endl;
+	
+	Marlin dict("",Distribution::pdf(256, Distribution::Laplace, 0.6));
+	MarlinWorkspace *workspace = Marlin_create_workspace();
+	const size_t *scratch = nullptr;
+	
+	// Sources sparser than the dictionary expects need unrepresented symbols, and may end up raw.
+	// The second pass needs no more scratch memory than the first one.
+	for (int pass=0; pass<2; pass++) {
+		if (pass) scratch = workspace->unrepresentedSymbols.data();
+		for (double p : {0.9, 0.6, 0.3, 0.1, 0.01}) {
+			for (size_t sz : {5, 64, 4096, 65536+5}) {
+				
+				const std::vector<uint8_t> original(Distribution::getResiduals(Distribution::pdf(Distribution::Laplace, p),sz));
+				std::vector<uint8_t> expected(sz), compressed(sz);
+				std::vector<uint8_t> uncompressed(sz);
+				
+				ssize_t expectedSize = dict.compress(original, expected);
+				ssize_t compressedSize = Marlin_compress_with_workspace(&dict, workspace, compressed.data(), sz, original.data(), sz);
+				compressed.resize(std::max(compressedSize, ssize_t(0)));
+				
+				if (compressedSize != expectedSize or compressed != expected or
+					dict.decompress(compressed, uncompressed) != ssize_t(sz) or original != uncompressed) {
+				
+					std::cout << "FAIL! workspace P: " << p << " size: " << sz << std::endl;
+					Marlin_free_workspace(workspace);
+					return false;
+				}
+			}
+		}
+	}
+	
+	// The scratch memory grew to the most unrepresented symbols of a block, then was reused.
+	bool reused = workspace->unrepresentedSymbols.data() == scratch;
+	Marlin_free_workspace(workspace);
+	if (not reused) {
+		std::cout << "FAIL! workspace was reallocated" << std::endl;
+		return false;
+	}
+	
+	std::cout << "Original == uncompressed!" << std::endl;
+	return true;
+}
+
+static bool testUnrepresented() {
+	
+	std::cout << "Test Unrepresented" << std::endl;
+	
+	Marlin dict("",Distribution::pdf(256, Distribution::Laplace, 0.5));
+	const uint8_t outlier = 128;
+	if (dict.source2marlin[outlier>>dict.shift] != dict.unrepresentedSymbolToken) {
+		std::cout << "FAIL! " << int(outlier) << " is represented" << std::endl;
+		return false;
+	}
+	
+	// Rare outliers cost a few bytes each, however many there are.
+	for (size_t sz : {4096+3, 65536}) {
+		
+		const std::vector<uint8_t> clean(Distribution::getResiduals(Distribution::pdf(Distribution::Laplace, 0.5),sz));
+		std::vector<uint8_t> compressed(sz);
+		dict.compress(clean, compressed);
+		const size_t cleanSize = compressed.size();
+		
+		for (size_t nOutliers : {1, 200, 300, 1000}) {
+			
+			std::vector<uint8_t> original = clean;
+			for (size_t i=0; i<nOutliers; i++)
+				original[i*7919%sz] = outlier;
+			
+			std::vector<uint8_t> uncompressed(sz);
+			compressed.resize(sz);
+			if (dict.compress(original, compressed) < 0 or compressed.size() > cleanSize + 4*nOutliers or
+				dict.decompress(compressed, uncompressed) != ssize_t(sz) or original != uncompressed) {
+				
+				std::cout << "FAIL! outliers: " << nOutliers << " size: " << sz << " compressed: " << compressed.size() << " clean: " << cleanSize << std::endl;
+				return false;
+			}
+		}
+	}
+	
+	std::cout << "Original == uncompressed!" << std::endl;
+	return true;
+}
+
+static bool testRuns() {
+	
+	std::cout << "Test Runs" << std::endl;
+	
+	Marlin dict("",Distribution::pdf(256, Distribution::Laplace, 0.3));
+	Marlin skipDict("",Distribution::pdf(256, Distribution::Laplace, 0.9));
+	
+	// Sparse residuals: data broken by long runs of zeros, which may start or end the block.
+	for (const Marlin *d : {&dict, &skipDict}) {
+		for (size_t sz : {1000, 4096+5, 65536}) {
+			for (size_t runLength : {255, 256, 300, 4000, 60000}) {
+				
+				const std::vector<uint8_t> data(Distribution::getResiduals(Distribution::pdf(Distribution::Laplace, 0.3),sz));
+				std::vector<uint8_t> original = data;
+				for (size_t start : {size_t(0), sz/3, sz-std::min(sz, runLength)})
+					std::fill(original.begin()+start, original.begin()+std::min(sz, start+runLength), 0);
+				original[sz/2] = 1;
+				
+				std::vector<uint8_t> compressed(sz), uncompressed(sz);
+				if (d->compress(original, compressed) < 0 or d->decompress(compressed, uncompressed) != ssize_t(sz) or
+					original != uncompressed) {
+					
+					std::cout << "FAIL! runs size: " << sz << " run: " << runLength << std::endl;
+					return false;
+				}
+			}
+		}
+	}
+	
+	// A run costs a few bytes, however long it is.
+	const std::vector<uint8_t> data(Distribution::getResiduals(Distribution::pdf(Distribution::Laplace, 0.3),4096));
+	std::vector<uint8_t> compressed(data.size());
+	dict.compress(data, compressed);
+	const size_t dataSize = compressed.size();
+	
+	std::vector<uint8_t> original(1<<20, 0);
+	std::copy(data.begin(), data.end(), original.begin() + 12345);
+	compressed.resize(original.size());
+	if (dict.compress(original, compressed) < 0 or compressed.size() > dataSize + 16) {
+		std::cout << "FAIL! run costs: " << compressed.size() - dataSize << std::endl;
+		return false;
+	}
+	std::cout << "1MB of zeros around 4KB of data: " << compressed.size() << " bytes, " << dataSize << " without them" << std::endl;
+	
+	return true;
+}
+
+static bool testEstimate() {
+	
+	std::cout << "Test Estimate" << std::endl;
+	
+	for (size_t sz : {0, 7, 1000, 65536+3}) {
+		
+		std::vector<uint8_t> src(sz);
+		for (auto &&s : src) s = rand() % 7;
+		
+		std::array<size_t, 256> hist;
+		hist.fill(0);
+		for (auto &&s : src) hist[s]++;
+		
+		if (marlin::histogram(marlin::View<const uint8_t>(src.data(), src.data()+sz)) != hist) {
+			std::cout << "FAIL! histogram size: " << sz << std::endl;
+			return false;
+		}
+	}
+	
+	std::vector<std::unique_ptr<Marlin>> dictionaries;
+	std::vector<const Marlin *> dictionaryList;
+	for (double p=0.05; p<1; p+=0.1) {
+		dictionaries.emplace_back(new Marlin("",Distribution::pdf(256, Distribution::Laplace, p)));
+		dictionaryList.push_back(dictionaries.back().get());
+	}
+	dictionaryList.push_back(nullptr);
+	
+	// The estimated best dictionary must compress almost as well as the real best one.
+	for (double p : {0.1, 0.2, 0.33, 0.5, 0.7, 0.9}) {
+		for (size_t sz : {256, 4096, 65536}) {
+			
+			std::vector<uint8_t> original(Distribution::getResiduals(Distribution::pdf(Distribution::Laplace, p),sz));
+			
+			size_t bestSize = sz;
+			for (auto &&dict : dictionaries) {
+				std::vector<uint8_t> compressed(sz);
+				dict->compress(original, compressed);
+				bestSize = std::min(bestSize, compressed.size());
+			}
+			
+			const Marlin *estimated = Marlin_estimate_best_dictionary(dictionaryList.data(), original.data(), sz);
+			std::vector<uint8_t> compressed(sz);
+			if (estimated == nullptr or estimated->compress(original, compressed) < 0 or compressed.size() > bestSize*1.03) {
+				std::cout << "FAIL! estimate P: " << p << " size: " << sz << std::endl;
+				return false;
+			}
+		}
+	}
+	
+	std::cout << "Estimated dictionaries are close to the best!" << std::endl;
+	return true;
+}
+
+static bool testBlockStats() {
+	
+	std::cout << "Test BlockStats" << std::endl;
+	
+	Marlin dict("",Distribution::pdf(256, Distribution::Laplace, 0.5));
+	marlin::MarlinWorkspace workspace;
+	
+	// Runs of every length, a single symbol, and a single symbol but for the last one.
+	for (size_t sz : {0, 1, 7, 16, 17, 255*16+1, 255*16+2, 65536+3}) {
+		for (size_t runLength : std::initializer_list<size_t>{1, 3, 100, sz+1, sz}) {
+			
+			std::vector<uint8_t> src(sz);
+			for (size_t i=0; i<sz; i++) src[i] = runLength > sz ? 7 : i/runLength % 5;
+			if (runLength == sz and sz > 1) src.back() = 8;
+			
+			std::array<size_t, 256> hist;
+			hist.fill(0);
+			size_t nRepeated = 0;
+			for (size_t i=0; i<sz; i++) {
+				hist[src[i]]++;
+				nRepeated += i and src[i] == src[i-1];
+			}
+			
+			const marlin::View<const uint8_t> view(src.data(), src.data()+sz);
+			auto stats = marlin::blockStats(view);
+			std::vector<uint8_t> compressed(sz), compressedWithStats(sz), uncompressed(sz);
+			if (stats.histogram != hist or stats.nElements != sz or stats.nRepeated != nRepeated or
+				dict.compress(src, compressed) < 0 or
+				dict.compress(view, marlin::make_view(compressedWithStats), workspace, stats) != ssize_t(compressed.size()) or
+				not std::equal(compressed.begin(), compressed.end(), compressedWithStats.begin()) or
+				dict.decompress(compressed, uncompressed) != ssize_t(sz) or src != uncompressed) {
+				
+				std::cout << "FAIL! stats size: " << sz << " run: " << runLength << std::endl;
+				return false;
+			}
+			
+			if (runLength > sz and sz and (not stats.isSingleSymbol() or compressed.size() != 1 or dict.estimateSize(stats) != 1.)) {
+				std::cout << "FAIL! single symbol size: " << sz << std::endl;
+				return false;
+			}
+		}
+		
+		std::vector<uint16_t> src16(sz);
+		for (size_t i=0; i<sz; i++) src16[i] = i/3 * 4099;
+		const marlin::View<const uint16_t> view16(src16.data(), src16.data()+sz);
+		auto stats16 = marlin::blockStats(view16);
+		if (stats16.histogram != marlin::histogram(view16) or stats16.nRepeated != sz - (sz+2)/3) {
+			std::cout << "FAIL! 16 bit stats size: " << sz << std::endl;
+			return false;
+		}
+	}
+	
+	std::cout << "Stats match!" << std::endl;
+	return true;
+}
+
+static bool testPrebuilt() {
+	
+	std::cout << "Test Prebuilt" << std::endl;
+	
+	size_t nDictionaries = 0;
+	for (const Marlin **dict = Marlin_get_prebuilt_dictionaries(); *dict; dict++, nDictionaries++) {
+		
+		std::vector<uint8_t> original(Distribution::getResiduals(Distribution::pdf(Distribution::Laplace, 0.3),4096));
+		std::vector<uint8_t> compressed(4096), uncompressed(4096);
+		
+		if ((*dict)->compress(original, compressed) < 0 or 
+			(*dict)->decompress(compressed, uncompressed) != 4096 or original != uncompressed) {
+			
+			std::cout << "FAIL! prebuilt dictionary " << (*dict)->name << std::endl;
+			return false;
+		}
+	}
+	
+	if (nDictionaries == 0) {
+		std::cout << "FAIL! no prebuilt dictionaries" << std::endl;
+		return false;
+	}
+	
+	std::cout << nDictionaries << " prebuilt dictionaries roundtrip!" << std::endl;
+	return true;
+}
+
+static bool testDictionaryFile() {
+	
+	std::cout << "Test Dictionary File" << std::endl;
+	
+	const char *path = "correctness_dictionary.bin";
+	
+	Marlin built("built",Distribution::pdf(256, Distribution::Laplace, 0.3));
+	const Marlin *prebuilt = Marlin_get_prebuilt_dictionaries()[0];
+	
+	for (const Marlin *dict : {static_cast<const Marlin *>(&built), prebuilt}) {
+		
+		std::unique_ptr<Marlin> loaded;
+		if (Marlin_save_dictionary(dict, path) == 0)
+			loaded.reset(Marlin_load_dictionary(path));
+		
+		if (not loaded or loaded->name != dict->name or loaded->symbolCost != dict->symbolCost) {
+			std::cout << "FAIL! could not reload " << dict->name << std::endl;
+			return false;
+		}
+		
+		std::vector<uint8_t> original(Distribution::getResiduals(Distribution::pdf(Distribution::Laplace, 0.3),4096));
+		std::vector<uint8_t> expected(4096), compressed(4096), uncompressed(4096);
+		
+		if (dict->compress(original, expected) < 0 or loaded->compress(original, compressed) < 0 or 
+			expected != compressed or loaded->decompress(compressed, uncompressed) != 4096 or original != uncompressed) {
+			
+			std::cout << "FAIL! loaded dictionary " << dict->name << " does not match" << std::endl;
+			return false;
+		}
+	}
+	
+	// A skip dictionary with a word longer than maxWordSize must be rejected.
+	if (built.isSkip) {
+		std::vector<uint8_t> table(*built.decompressorTableVector);
+		table[built.maxWordSize] = built.maxWordSize+1;
+		Marlin corrupted(built.name, built.K, built.O, built.shift, built.maxWordSize, built.efficiency,
+			built.unrepresentedSymbolToken, built.source2marlin, built.compressorTablePointer, built.compressorTableInitPointer,
+			table.data(), built.marlinMostCommonSymbol, built.isSkip);
+		if (Marlin_save_dictionary(&corrupted, path) != 0 or Marlin_load_dictionary(path) != nullptr) {
+			std::cout << "FAIL! dictionary file with a corrupted skip table was loaded" << std::endl;
+			return false;
+		}
+	} else {
+		std::cout << "FAIL! expected a skip dictionary" << std::endl;
+		return false;
+	}
+	
+	// A truncated file must be rejected.
+	if (truncate(path, 1000) != 0 or Marlin_load_dictionary(path) != nullptr) {
+		std::cout << "FAIL! truncated dictionary file was loaded" << std::endl;
+		return false;
+	}
+	unlink(path);
+	
+	std::cout << "Loaded dictionaries match!" << std::endl;
+	return true;
+}
+
+static bool testTuning() {
+	
+	std::cout << "Test Tuning" << std::endl;
+	
+	// Candidate dictionaries built concurrently must lead to the same choice as a sequential search.
+	for (double p : {0.1, 0.5, 0.9}) {
+		
+		marlin::Configuration sequential, concurrent;
+		sequential["threads"] = 1;
+		concurrent["threads"] = 4;
+		Marlin a("",Distribution::pdf(256, Distribution::Gaussian, p), sequential);
+		Marlin b("",Distribution::pdf(256, Distribution::Gaussian, p), concurrent);
+		
+		if (a.shift != b.shift or a.maxWordSize != b.maxWordSize or a.efficiency != b.efficiency or
+			*a.decompressorTableVector != *b.decompressorTableVector) {
+			
+			std::cout << "FAIL! tuning P: " << p << std::endl;
+			return false;
+		}
+	}
+	
+	std::cout << "Tuning does not depend on the number of threads!" << std::endl;
+	return true;
+}
+
+static bool testAdaptive() {
+	
+	std::cout << "Test Adaptive" << std::endl;
+	
+	const size_t blockSize = 1<<14;
+	std::shared_ptr<const Marlin> initial = std::make_shared<Marlin>("",Distribution::pdf(256, Distribution::Laplace, 0.1));
+	MarlinAdaptiveCompress compressor(initial, marlin::Configuration(), 0.05, 1<<16);
+	MarlinAdaptiveDecompress decompressor(initial);
+	
+	// The data drifts away from the initial dictionary, which must be replaced.
+	std::vector<uint8_t> original, stream;
+	size_t lastSize = 0;
+	for (size_t i=0; i<16; i++) {
+		
+		std::vector<uint8_t> block(Distribution::getResiduals(Distribution::pdf(Distribution::Laplace, i<2 ? 0.1 : 0.8),blockSize));
+		std::vector<uint8_t> record(MarlinAdaptiveCompress::bound(blockSize));
+		if (compressor.compress(block, record) < 0) {
+			std::cout << "FAIL! adaptive compress block: " << i << std::endl;
+			return false;
+		}
+		if (i == 8) compressor.wait();
+		
+		original.insert(original.end(), block.begin(), block.end());
+		stream.insert(stream.end(), record.begin(), record.end());
+		lastSize = record.size();
+	}
+	
+	std::vector<uint8_t> reference(blockSize);
+	initial->compress(std::vector<uint8_t>(original.end()-blockSize, original.end()), reference);
+	if (compressor.dictionaryId() == 0 or lastSize >= reference.size()) {
+		std::cout << "FAIL! dictionary was not retrained " << lastSize << " " << reference.size() << std::endl;
+		return false;
+	}
+	
+	std::vector<uint8_t> uncompressed(original.size());
+	if (decompressor.decompress(stream, uncompressed) != ssize_t(original.size()) or uncompressed != original or 
+		decompressor.dictionaryId() != compressor.dictionaryId()) {
+		std::cout << "FAIL! adaptive stream does not roundtrip" << std::endl;
+		return false;
+	}
+	
+	std::cout << "Adaptive stream switched to dictionary " << compressor.dictionaryId() << " and roundtrips!" << std::endl;
+	return true;
+}
+
+static bool testFrame() {
+	
+	std::cout << "Test Frame" << std::endl;
+	
+	// Reference XXH64 values, also when the input is fed in pieces.
+	const std::string text = "Nobody inspects the spammish repetition";
+	for (size_t split : {size_t(0), size_t(5), size_t(33), text.size()}) {
+		marlin::XXHash64 hash;
+		hash.update(text.data(), split);
+		hash.update(text.data()+split, text.size()-split);
+		marlin::XXHash64 empty;
+		if (hash.digest() != 0xFBCEA83C8A378BF1ULL or empty.digest() != 0xEF46DB3751D8E999ULL) {
+			std::cout << "FAIL! checksum split: " << split << std::endl;
+			return false;
+		}
+	}
+	
+	const Marlin *dict = Marlin_get_prebuilt_dictionaries()[4];
+	const Marlin *other = Marlin_get_prebuilt_dictionaries()[5];
+	for (size_t sz : {0, 1, 1000, 3*65536+7}) {
+		for (bool checksum : {false, true}) {
+			
+			std::vector<uint8_t> original(Distribution::getResiduals(Distribution::pdf(Distribution::Laplace, 0.3),sz));
+			std::vector<uint8_t> frame(Marlin::frameBound(sz));
+			if (dict->compressFrame(original, frame, checksum) < 0 or 
+				Marlin::frameContentSize(marlin::View<const uint8_t>(frame.data(), frame.data()+frame.size())) != ssize_t(sz) or 
+				Marlin::frameDictionaryId(marlin::View<const uint8_t>(frame.data(), frame.data()+frame.size())) != dict->id) {
+				std::cout << "FAIL! frame header size: " << sz << std::endl;
+				return false;
+			}
+			
+			// Header fields are little endian: contentSize is at byte 16.
+			uint64_t contentSize = 0;
+			for (size_t i=0; i<8; i++) contentSize |= uint64_t(frame[16+i]) << (8*i);
+			if (contentSize != sz) {
+				std::cout << "FAIL! frame header byte order size: " << sz << std::endl;
+				return false;
+			}
+			
+			std::vector<uint8_t> uncompressed(sz);
+			if (dict->decompressFrame(frame, uncompressed) != ssize_t(sz) or uncompressed != original) {
+				std::cout << "FAIL! frame roundtrip size: " << sz << std::endl;
+				return false;
+			}
+			
+			if (sz and other->decompressFrame(frame, uncompressed) >= 0) {
+				std::cout << "FAIL! frame decoded by another dictionary" << std::endl;
+				return false;
+			}
+		}
+	}
+	
+	// Uniform data is stored raw, so corrupting it is only caught by the checksum.
+	std::vector<uint8_t> original(4096), frame(Marlin::frameBound(4096)), uncompressed(4096);
+	for (auto &&s : original) s = rand();
+	dict->compressFrame(original, frame, true);
+	frame[frame.size()/2] ^= 1;
+	if (dict->decompressFrame(frame, uncompressed) >= 0) {
+		std::cout << "FAIL! corrupted frame was accepted" << std::endl;
+		return false;
+	}
+	
+	std::cout << "Frames roundtrip and detect corruption!" << std::endl;
+	return true;
+}
+
+static bool testStream() {
+	
+	std::cout << "Test Stream" << std::endl;
+	
+	// Two frames back to back: one through the C++ stream with small blocks, one through
+	// the C API. Input and output arrive in odd sized pieces.
+	std::vector<uint8_t> first(Distribution::getResiduals(Distribution::pdf(Distribution::Laplace, 0.3),50000));
+	std::vector<uint8_t> second(Distribution::getResiduals(Distribution::pdf(Distribution::Laplace, 0.3),3*65536+7));
+	
+	const Marlin **prebuilt = Marlin_get_prebuilt_dictionaries();
+	const Marlin *dict = Marlin_estimate_best_dictionary(prebuilt, first.data(), first.size());
+	const Marlin *other = dict == prebuilt[0] ? prebuilt[1] : prebuilt[0];
+	std::vector<uint8_t> compressed;
+	
+	uint8_t out[777];
+	MarlinCStream cs(*dict, true, 5000);
+	for (size_t i=0; i<first.size(); i+=1000) {
+		marlin::View<const uint8_t> in(first.data()+i, first.data()+std::min(i+1000, first.size()));
+		while (in.nElements()) {
+			marlin::View<uint8_t> o(out, out+sizeof(out));
+			if (cs.compress(in, o) < 0) {
+				std::cout << "FAIL! stream compression" << std::endl;
+				return false;
+			}
+			compressed.insert(compressed.end(), out, o.start);
+		}
+	}
+	for (ssize_t r=1; r;) {
+		marlin::View<uint8_t> o(out, out+sizeof(out));
+		r = cs.end(o);
+		compressed.insert(compressed.end(), out, o.start);
+	}
+	
+	MarlinCStream *ccs = Marlin_create_cstream(dict, 0);
+	for (size_t srcPos=0; srcPos<second.size();) {
+		size_t dstPos = 0;
+		Marlin_compress_stream(ccs, out, sizeof(out), &dstPos, second.data(), std::min(srcPos+1000, second.size()), &srcPos);
+		compressed.insert(compressed.end(), out, out+dstPos);
+	}
+	for (ssize_t r=1; r;) {
+		size_t dstPos = 0;
+		r = Marlin_end_stream(ccs, out, sizeof(out), &dstPos);
+		compressed.insert(compressed.end(), out, out+dstPos);
+	}
+	Marlin_free_cstream(ccs);
+	
+	if (compressed.size() >= first.size() + second.size()) {
+		std::cout << "FAIL! stream did not compress" << std::endl;
+		return false;
+	}
+	
+	auto decode = [&compressed](const Marlin *d, std::vector<uint8_t> &uncompressed) {
+		
+		MarlinDStream *ds = Marlin_create_dstream(d);
+		size_t frames = 0;
+		ssize_t r = 0;
+		uint8_t buf[1234];
+		for (size_t srcPos=0; srcPos<compressed.size() or r>0;) {
+			size_t dstPos = 0;
+			r = Marlin_decompress_stream(ds, buf, sizeof(buf), &dstPos, compressed.data(), std::min(srcPos+333, compressed.size()), &srcPos);
+			uncompressed.insert(uncompressed.end(), buf, buf+dstPos);
+			if (r < 0) break;
+			if (r == 0) frames++;
+			if (r > 0 and dstPos == 0 and srcPos == compressed.size()) break;
+		}
+		Marlin_free_dstream(ds);
+		return r < 0 ? -1 : ssize_t(frames);
+	};
+	
+	std::vector<uint8_t> uncompressed, expected(first);
+	expected.insert(expected.end(), second.begin(), second.end());
+	if (decode(dict, uncompressed) != 2 or uncompressed != expected) {
+		std::cout << "FAIL! stream roundtrip" << std::endl;
+		return false;
+	}
+	
+	uncompressed.clear();
+	if (decode(other, uncompressed) >= 0) {
+		std::cout << "FAIL! stream decoded by another dictionary" << std::endl;
+		return false;
+	}
+	
+	// The first frame has a checksum, so any flipped bit in it must be caught.
+	compressed[compressed.size()/8] ^= 4;
+	uncompressed.clear();
+	if (decode(dict, uncompressed) >= 0) {
+		std::cout << "FAIL! corrupted stream was accepted" << std::endl;
+		return false;
+	}
+	
+	std::cout << "Streams roundtrip and detect corruption!" << std::endl;
+	return true;
+}
+
+static bool testResiduals() {
+	
+	std::cout << "Test Residuals" << std::endl;
+	
+	std::vector<uint8_t> original(4096+8*7);
+	for (auto &&o : original) o = rand();
+	
+	for (const marlin::ResidualKernel *k = marlin::residualKernels(); k->name; k++) {
+		
+		if (not marlin::cpuSupports(k->level)) {
+			std::cout << "Skipping kernel " << k->name << std::endl;
+			continue;
+		}
+		
+		for (size_t shift=0; shift<=8; shift++) {
+			for (size_t sz : {8, 16, 24, 56, 64, 72, 128, 4096, 4096+8*7}) {
+				
+				uint8_t mask = (1U<<shift)-1;
+				std::vector<uint8_t> packed(sz*shift/8+1, 0xAA), reference(sz*shift/8+1, 0xAA);
+				std::vector<uint8_t> uncompressed(sz);
+				for (size_t i=0; i<sz; i++) uncompressed[i] = original[i] & ~mask;
+				
+				size_t packedSize = k->pack(original.data(), sz, packed.data(), shift);
+				for (const marlin::ResidualKernel *r = marlin::residualKernels(); r->name; r++)
+					if (not strcmp(r->name, "scalar")) r->pack(original.data(), sz, reference.data(), shift);
+				
+				size_t unpackedSize = k->unpack(packed.data(), uncompressed.data(), sz, shift);
+
+				if (packedSize != sz*shift/8 or unpackedSize != packedSize or 
+					packed != reference or packed.back() != 0xAA or
+					not std::equal(uncompressed.begin(), uncompressed.end(), original.begin())) {
+					
+					std::cout << "FAIL! kernel " << k->name << " shift " << shift << " size " << sz << std::endl;
+					return false;
+				}
+			}
+		}
+		
+		std::vector<uint16_t> original16(original.size()/2);
+		memcpy(original16.data(), original.data(), original16.size()*sizeof(uint16_t));
+		for (size_t shift=0; shift<16; shift++) {
+			for (size_t sz : {8, 16, 24, 56, 64, 72, 128, 2048, 2048+8*3}) {
+				
+				uint16_t mask = (1U<<shift)-1;
+				std::vector<uint8_t> packed(sz*shift/8+1, 0xAA), reference(sz*shift/8+1, 0xAA);
+				std::vector<uint16_t> uncompressed(sz);
+				for (size_t i=0; i<sz; i++) uncompressed[i] = original16[i] & ~mask;
+				
+				size_t packedSize = k->pack16(original16.data(), sz, packed.data(), shift);
+				for (const marlin::ResidualKernel *r = marlin::residualKernels(); r->name; r++)
+					if (not strcmp(r->name, "scalar")) r->pack16(original16.data(), sz, reference.data(), shift);
+				
+				size_t unpackedSize = k->unpack16(packed.data(), uncompressed.data(), sz, shift);
+
+				if (packedSize != sz*shift/8 or unpackedSize != packedSize or 
+					packed != reference or packed.back() != 0xAA or
+					not std::equal(uncompressed.begin(), uncompressed.end(), original16.begin())) {
+					
+					std::cout << "FAIL! 16 bit kernel " << k->name << " shift " << shift << " size " << sz << std::endl;
+					return false;
+				}
+			}
+		}
+		std::cout << "Kernel " << k->name << " OK" << std::endl;
+	}
+	return true;
+}
+
+static bool testUint16() {
+	
+	std::cout << "Test Uint16" << std::endl;
+	
+	// 12 bit samples around a mid level: the Laplacian part is for Marlin, the noise of
+	// the low bits is left to the residuals.
+	auto samples = [](size_t sz) {
+		std::vector<uint8_t> residuals(Distribution::getResiduals(Distribution::pdf(Distribution::Laplace, 0.3),sz));
+		std::vector<uint16_t> ret(sz);
+		for (size_t i=0; i<sz; i++) ret[i] = 2048 + int8_t(residuals[i])*8 + rand()%8;
+		return ret;
+	};
+	
+	auto histogram = marlin::histogram<uint16_t>(marlin::make_view(samples(1<<18)));
+	std::vector<double> sourceAlphabet(histogram.begin(), histogram.end());
+	for (auto &&p : sourceAlphabet) p /= 1<<18;
+	
+	for (size_t maxWordSize : {0, 3, 7, 15}) {
+		
+		marlin::Configuration conf;
+		conf["K"] = 8;
+		if (maxWordSize) conf["maxWordSize"] = maxWordSize;
+		if (maxWordSize) conf["shift"] = 3;
+		Marlin16 dict("", sourceAlphabet, conf);
+		
+		for (size_t sz : {0, 5, 1000, (1<<18)+3}) {
+			
+			std::vector<uint16_t> original = samples(sz);
+			// A flat region, which is cut out as a run.
+			std::fill(original.begin()+sz/4, original.begin()+sz/2, dict.runSymbol);
+			std::vector<uint8_t> compressed(2*sz), parallel(Marlin16::parallelBound(sz, 1<<16)), frame(Marlin16::frameBound(sz));
+			std::vector<uint16_t> uncompressed(sz), uncompressedParallel(sz), uncompressedFrame(sz);
+			
+			if (dict.compress(original, compressed) < 0 or dict.decompress(compressed, uncompressed) != ssize_t(sz) or
+				dict.compressParallel(original, parallel, 1<<16) < 0 or dict.decompressParallel(parallel, uncompressedParallel) != ssize_t(sz) or
+				dict.compressFrame(original, frame) < 0 or dict.decompressFrame(frame, uncompressedFrame) != ssize_t(sz) or
+				original != uncompressed or original != uncompressedParallel or original != uncompressedFrame) {
+				
+				std::cout << "FAIL! 16 bit roundtrip maxWordSize: " << dict.maxWordSize << " size: " << sz << std::endl;
+				return false;
+			}
+			
+			if (sz > 1000 and compressed.size() > sz*sizeof(uint16_t)/2) {
+				std::cout << "FAIL! 16 bit samples did not compress: " << compressed.size() << std::endl;
+				return false;
+			}
+		}
+		std::cout << "maxWordSize " << dict.maxWordSize << " shift " << dict.shift << " efficiency " << dict.efficiency << " OK" << std::endl;
+	}
+	
+	// Blocks of 8 to 15 symbols of a low entropy source can code to sizeof(uint16_t)
+	// bytes, the size of a single symbol block.
+	std::vector<double> lowEntropy = Distribution::pdf(4096, Distribution::Laplace, 0.1);
+	lowEntropy.resize(1<<16, 0.);
+	for (size_t K : {6, 8}) {
+		for (size_t maxWordSize : {7, 15, 31}) {
+			
+			marlin::Configuration conf;
+			conf["K"] = K;
+			conf["maxWordSize"] = maxWordSize;
+			Marlin16 dict("", lowEntropy, conf);
+			
+			for (size_t sz=8; sz<16; sz++) {
+				for (size_t i=0; i<sz; i++) for (uint16_t symbol : {1, 2, 4095}) {
+					
+					std::vector<uint16_t> original(sz, 0);
+					original[i] = symbol;
+					std::vector<uint8_t> compressed(2*sz);
+					std::vector<uint16_t> uncompressed(sz);
+					if (dict.compress(original, compressed) < 0 or dict.decompress(compressed, uncompressed) != ssize_t(sz) or
+						original != uncompressed) {
+						
+						std::cout << "FAIL! small 16 bit block K: " << K << " maxWordSize: " << maxWordSize << " size: " << sz << std::endl;
+						return false;
+					}
+				}
+			}
+		}
+	}
+	return true;
+}
+
 
 int main() {
 
 	return 
+		testResiduals() and
 		testMini() and
 		testLaplace() and
+		testParallel() and
+		testDecoders() and testWorkspace() and testUnrepresented() and testRuns() and testEstimate() and testBlockStats() and testPrebuilt() and testDictionaryFile() and testTuning() and testAdaptive() and testFrame() and testStream() and testUint16() and
 		true?0:-1;
 }
@@ -0,0 +1,243 @@
+#include "marlin.h"
+#include "../src/distribution.hpp"
+#include "../src/kernels.hpp"
+#include "../src/reference.hpp"
+#include <iostream>
+#include <random>
+#include <cstring>
+#include <cstdlib>
+#include <tuple>
+#include <stdexcept>
+
+// Differential fuzzing of the kernels. Each case builds a dictionary somewhere in the
+// K, O, shift and maxWordSize space and a source for it. Every encoder must write the
+// stream of the reference encoder (see reference.hpp) and every decoder must decode
+// that stream as the reference decoder does, writing nothing past its output. Whole
+// blocks must roundtrip too.
+//
+// Standalone, it checks as many random dictionaries as the first argument says (from
+// the seed in the second one). Compiled with MARLIN_LIBFUZZER (see WITH_LIBFUZZER), the first
+// bytes of each input select the dictionary and the rest is the source.
+
+namespace {
+
+struct Case {
+	size_t K, O, shift, maxWordSize;
+	Distribution::Type type;
+	double h;
+};
+
+std::ostream &operator<<(std::ostream &os, const Case &c) {
+	return os << "K: " << c.K << " O: " << c.O << " shift: " << c.shift << " maxWordSize: " << c.maxWordSize
+		<< " type: " << c.type << " h: " << c.h;
+}
+
+// Building a dictionary takes far longer than checking it, so they are kept.
+template<typename TSource>
+struct Dictionary {
+
+	const marlin::TMarlinDictionary<TSource,uint8_t> dictionary;
+	const marlin::TMarlin<TSource,uint8_t> codec;
+	const marlin::TMarlinReference<TSource,uint8_t> reference;
+
+	Dictionary(const Case &c, marlin::Configuration conf) :
+		dictionary(Distribution::sourcePdf<TSource>(c.type, c.h), conf),
+		codec("", dictionary),
+		reference(dictionary) {}
+
+	static const Dictionary &get(const Case &c) {
+
+		static std::map<std::tuple<size_t,size_t,size_t,size_t,int,double>, std::unique_ptr<Dictionary>> cache;
+		auto &&d = cache[std::make_tuple(c.K, c.O, c.shift, c.maxWordSize, int(c.type), c.h)];
+		if (not d) {
+			marlin::Configuration conf;
+			conf["K"] = c.K;
+			conf["O"] = c.O;
+			conf["shift"] = c.shift;
+			conf["maxWordSize"] = c.maxWordSize;
+			d.reset(new Dictionary(c, conf));
+		}
+		return *d;
+	}
+};
+
+template<typename TSource>
+bool fail(const Case &c, const std::string &what) {
+
+	std::cout << "FAIL! " << 8*sizeof(TSource) << " bit " << c << ": " << what << std::endl;
+	return false;
+}
+
+// Decodes the stream with every kernel, comparing with expected. The output is followed
+// by a guard that must be left untouched, and starts filled with garbage, as the decoders
+// must write every symbol.
+template<typename TSource>
+bool checkDecoders(const Case &c, const Dictionary<TSource> &d, const std::vector<uint8_t> &stream, const std::vector<TSource> &expected) {
+
+	constexpr size_t GUARD = 256;
+
+	for (auto &&kernel : marlin::decodeKernels<TSource,uint8_t>(d.codec.K, d.codec.O, d.codec.maxWordSize, d.codec.isSkip)) {
+
+		if (not marlin::cpuSupports(kernel.level)) continue;
+
+		// The stream in a buffer of its own, so that reading past it is caught by ASan.
+		const std::vector<uint8_t> input(stream);
+		std::vector<TSource> output(expected.size() + GUARD, TSource(0x5555));
+
+		kernel.decode(d.codec, marlin::make_view(input), marlin::make_view(output.data(), output.data()+expected.size()));
+
+		if (not std::equal(expected.begin(), expected.end(), output.begin()))
+			return fail<TSource>(c, std::string("decoder ") + kernel.name);
+		for (size_t i=expected.size(); i<output.size(); i++)
+			if (output[i] != TSource(0x5555))
+				return fail<TSource>(c, std::string("decoder ") + kernel.name + " writes past its output");
+	}
+	return true;
+}
+
+template<typename TSource>
+bool check(const Case &c, const std::vector<TSource> &src) {
+
+	const Dictionary<TSource> &d = Dictionary<TSource>::get(c);
+	if (src.empty()) return true;
+
+	// Encoders against the reference, as a single stream.
+	// The reference throws if a word is followed by a symbol that its next chapter lacks.
+	std::vector<size_t> unrepresented;
+	std::vector<uint8_t> stream;
+	try {
+		stream = d.reference.encode(marlin::make_view(src), unrepresented);
+	} catch (std::out_of_range &) {
+		return fail<TSource>(c, "a chapter lacks a word of one symbol");
+	}
+
+	for (auto &&kernel : marlin::encodeKernels<TSource,uint8_t>()) {
+
+		if (not marlin::cpuSupports(kernel.level)) continue;
+
+		std::vector<uint8_t> encoded(2*src.size()*sizeof(TSource) + 64);
+		std::vector<size_t> kernelUnrepresented;
+		ssize_t sz = kernel.encode(d.codec, marlin::make_view(src), marlin::make_view(encoded), kernelUnrepresented);
+		if (sz < 0) return fail<TSource>(c, std::string("encoder ") + kernel.name + " runs out of room");
+		encoded.resize(sz);
+		if (encoded != stream or kernelUnrepresented != unrepresented)
+			return fail<TSource>(c, std::string("encoder ") + kernel.name);
+	}
+
+	// The reference decoder must give back src, with its low bits cleared and the
+	// unrepresented symbols replaced by the most common one.
+	std::vector<TSource> expected(src.size());
+	if (not d.reference.decode(marlin::View<const uint8_t>(stream.data(), stream.data()+stream.size()), marlin::make_view(expected)))
+		return fail<TSource>(c, "reference stream ends early");
+	for (size_t i=0, u=0; i<src.size(); i++) {
+		TSource s = TSource(src[i] >> c.shift << c.shift);
+		if (u < unrepresented.size() and unrepresented[u] == i) {
+			s = d.codec.marlinMostCommonSymbol;
+			u++;
+		}
+		if (expected[i] != s) return fail<TSource>(c, "reference roundtrip");
+	}
+
+	if (not checkDecoders(c, d, stream, expected)) return false;
+
+	// Whole blocks.
+	std::vector<uint8_t> compressed(src.size()*sizeof(TSource));
+	std::vector<TSource> uncompressed(src.size());
+	if (d.codec.compress(src, compressed) < 0 or d.codec.decompress(compressed, uncompressed) != ssize_t(src.size()) or
+		src != uncompressed)
+		return fail<TSource>(c, "block roundtrip");
+
+	return true;
+}
+
+const size_t Ks[] = { 4, 5, 6, 7, 8, 9, 10, 12 };
+const size_t maxWordSizes[] = { 3, 7, 15, 31, 63, 4, 5, 11, 100 };
+const double hs[] = { 0.05, 0.1, 0.2, 0.3, 0.5, 0.7, 0.9 };
+
+template<typename T, size_t N>
+const T &pick(const T (&v)[N], size_t i) { return v[i % N]; }
+
+}
+
+#ifdef MARLIN_LIBFUZZER
+
+// Byte 0 selects K and O, byte 1 maxWordSize and shift, byte 2 the distribution, its
+// entropy and the size of the symbols. The rest is the source.
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+
+	if (size < 3) return 0;
+
+	Case c;
+	c.K = pick(Ks, data[0]);
+	c.O = std::min(size_t(data[0]/8 % 5), 14-c.K);
+	c.maxWordSize = pick(maxWordSizes, data[1]);
+	c.shift = data[1]/16 % 3;
+	c.type = Distribution::Type(data[2] % 3);
+	c.h = pick(hs, data[2]/3);
+
+	bool ok;
+	if (data[2] & 0x80) {
+		std::vector<uint16_t> src((size-3)/2);
+		memcpy(src.data(), data+3, src.size()*sizeof(uint16_t));
+		for (auto &&s : src) s &= 0xFFF;
+		c.shift += 2;
+		ok = check(c, src);
+	} else {
+		ok = check(c, std::vector<uint8_t>(data+3, data+size));
+	}
+	if (not ok) abort();
+	return 0;
+}
+
+#else
+
+// Sources are drawn from a distribution near the one of the dictionary, so that some
+// symbols are missing from it, with runs of the most common symbol that make long words.
+template<typename TSource>
+std::vector<TSource> randomSource(const Case &c, std::mt19937 &rng) {
+
+	const double h = std::min(0.95, c.h * std::uniform_real_distribution<double>(0.7, 1.5)(rng));
+	const auto pdf = Distribution::sourcePdf<TSource>(c.type, h);
+	std::discrete_distribution<size_t> symbols(pdf.begin(), pdf.end());
+
+	size_t sz = std::exp(std::uniform_real_distribution<double>(0, std::log(1<<17))(rng));
+	std::vector<TSource> src(sz);
+	for (auto &&s : src) s = symbols(rng);
+
+	for (size_t runs = rng()%4; runs and sz; runs--) {
+		size_t start = rng()%sz, length = std::min(sz-start, size_t(rng()%2000));
+		std::fill(src.begin()+start, src.begin()+start+length, Dictionary<TSource>::get(c).codec.marlinMostCommonSymbol);
+	}
+	return src;
+}
+
+int main(int argc, char **argv) {
+
+	const size_t iterations = argc > 1 ? atoi(argv[1]) : 64;
+	std::mt19937 rng(argc > 2 ? atoi(argv[2]) : 1);
+
+	// Mostly the configurations that updateConf produces, now and then any of them.
+	std::cout << "Fuzzing " << iterations << " dictionaries" << std::endl;
+	for (size_t i=0; i<iterations; i++) {
+
+		Case c;
+		c.K = pick(Ks, rng()%3 ? rng()%6 : rng());
+		c.O = std::min(size_t(rng()%5), 14-c.K);
+		c.maxWordSize = pick(maxWordSizes, rng()%4 ? rng()%5 : rng());
+		c.type = Distribution::Type(rng()%3);
+		c.h = pick(hs, rng());
+		const bool wide = rng()%8 == 0;
+		c.shift = wide ? 2 + rng()%3 : rng()%3;
+
+		// Building the dictionary takes longer than checking it on a few sources.
+		for (size_t j=0; j<4; j++) {
+			bool ok = wide ? check(c, randomSource<uint16_t>(c, rng)) : check(c, randomSource<uint8_t>(c, rng));
+			if (not ok) return -1;
+		}
+	}
+
+	std::cout << "All kernels match the reference!" << std::endl;
+	return 0;
+}
+
+#endif
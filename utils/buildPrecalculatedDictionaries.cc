@@ -1,6 +1,7 @@
 #include <marlin.h>
 #include <distribution.hpp>
 #include <sstream>
+#include <fstream>
 
 static  void buildDictionaries(
 	std::map<std::string, std::shared_ptr<Marlin>> &dictionaries,
@@ -35,9 +36,14 @@ static  void buildDictionaries(
 }
 
 
-int main() {
+// Writes the source of Marlin_get_prebuilt_dictionaries to the file given as argument,
+// or to stdout. The build runs it to generate prebuilt.cc.
+int main(int argc, char **argv) {
 
-	auto &&out = std::cout;
+	std::ofstream file;
+	if (argc > 1) file.open(argv[1]);
+	std::ostream &out = argc > 1 ? file : std::cout;
+	if (not out) return -1;
 	
 	std::map<std::string, std::shared_ptr<Marlin>> builtDictionaries;
 	
@@ -50,16 +56,20 @@ int main() {
 		
 		
 		out << "static const std::array<uint8_t, 256> prebuilt_dictionary_" << dict.first << "_source2marlin = {";
-		for (auto &&p: dict.second->source2marlin) out << uint64_t(p) << ","; out << "};" << std::endl; 
+		for (auto &&p: dict.second->source2marlin) out << uint64_t(p) << ",";
+		out << "};" << std::endl;
 
 		out << "static const uint32_t prebuilt_dictionary_" << dict.first << "_compressorTableVector[] = {";
-		for (auto &&p: *dict.second->compressorTableVector) out << uint64_t(p) << ","; out << "};" << std::endl; 
+		for (auto &&p: *dict.second->compressorTableVector) out << uint64_t(p) << ",";
+		out << "};" << std::endl;
 
 		out << "static const uint32_t prebuilt_dictionary_" << dict.first << "_compressorTableInitVector[] = {";
-		for (auto &&p: *dict.second->compressorTableInitVector) out << uint64_t(p) << ","; out << "};" << std::endl; 
+		for (auto &&p: *dict.second->compressorTableInitVector) out << uint64_t(p) << ",";
+		out << "};" << std::endl;
 
 		out << "static const uint8_t prebuilt_dictionary_" << dict.first << "_decompressorTableVector[] = {";
-		for (auto &&p: *dict.second->decompressorTableVector) out << uint64_t(p) << ","; out << "};" << std::endl; 
+		for (auto &&p: *dict.second->decompressorTableVector) out << uint64_t(p) << ",";
+		out << "};" << std::endl;
 		
 		out << "static const Marlin prebuilt_dictionary_" << dict.first << "(" << std::endl;
 		out << "    \"" << dict.second->name << "\", // name" << std::endl; 
@@ -89,4 +99,5 @@ int main() {
 	out << "    return Marlin_all_prebuilt_dictionaries;" << std::endl;
 	out << "}" << std::endl;
 	
+	return out.good() ? 0 : -1;
 }
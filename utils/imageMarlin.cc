@@ -54,6 +54,7 @@ void usage() {
 			  << "[-profile=<profile>] [-ttype=<ttype>] [-entfreq=<entfreq>] [-v|-verbose]"
 	          << std::endl;
 	std::cout << "DECOMPRESSION Syntax: " << executable_name << "d <input_path> <output_path> "
+	          << "[-threads=<threads>]"
 	          << std::endl;
 	std::cout << std::endl;
 	std::cout << "Parameter meaning:" << std::endl;
@@ -76,6 +77,8 @@ void usage() {
 	          << " default=" << (int) ImageMarlinHeader::DEFAULT_RECONSTRUCTION_TYPE << std::endl;
 	std::cout << "  * entfreq:     entropy is calculated for 1 out of every entfreq blocks. "
 			  << "Default=" << ImageMarlinHeader::DEFAULT_ENTROPY_FREQUENCY << std::endl;
+	std::cout << "  * threads:     (optional, decompression only) number of decoding threads, "
+	          << "0 for all cores. Default=0" << std::endl;
 	std::cout << "  * verbose|v:   show extra info" << std::endl;
 	std::cout << std::endl;
 	std::cout << "Compression examples:" << std::endl;
@@ -110,7 +113,8 @@ void parse_arguments(int argc, char **argv,
 		ImageMarlinHeader::QuantizerType& qtype,
         ImageMarlinHeader::ReconstructionType& rectype,
         ImageMarlinHeader::TransformType& transtype,
-        uint32_t& blockEntropyFrequency
+        uint32_t& blockEntropyFrequency,
+        size_t& decodeThreads
 		) {
 	if (argc < 4) {
 		throw std::runtime_error("Invalid argument count");
@@ -140,14 +144,21 @@ void parse_arguments(int argc, char **argv,
 	}
 
 	// Optional parameters
-	if (argc > 4 && !mode_compress) {
-		throw std::runtime_error("Optional arguments can only appear for compression.");
-	}
 	std::regex re;
 	for (int i=4; i<argc; i++) {
 		std::string argument(argv[i]);
 		std::smatch match;
 
+		re = "-threads=([[:digit:]]+)";
+		if (std::regex_search(argument, match, re) && !mode_compress) {
+			decodeThreads = atoi(match.str(1).data());
+			continue;
+		}
+
+		if (!mode_compress) {
+			throw std::runtime_error("Optional arguments other than -threads can only appear for compression.");
+		}
+
 		re = "-qstep=([[:digit:]]+)";
 		if (std::regex_search(argument, match, re)) {
 			qstep = atoi(match.str(1).data());
@@ -232,13 +243,14 @@ int main(int argc, char **argv) {
 	ImageMarlinHeader::TransformType  transtype = ImageMarlinHeader::DEFAULT_TRANSFORM_TYPE;
 	uint32_t blockSize = ImageMarlinHeader::DEFAULT_BLOCK_WIDTH;
 	uint32_t entropyFrequency = ImageMarlinHeader::DEFAULT_ENTROPY_FREQUENCY;
+	size_t decodeThreads = 0;
 	std::string path_profile;
 	bool verbose = false;
 
 	try {
 		parse_arguments(argc, argv, mode_compress, input_path, output_path,
 				qstep, blockSize, path_profile, verbose,
-				qtype, rectype, transtype, entropyFrequency);
+				qtype, rectype, transtype, entropyFrequency, decodeThreads);
 	} catch (std::runtime_error ex) {
 		usage();
 		std::cerr << std::endl << "ERROR: " << ex.what() << std::endl;
@@ -280,7 +292,7 @@ int main(int argc, char **argv) {
 		}
 
 		ImageMarlinHeader decompressedHeader(compressedData);
-		ImageMarlinDecoder* decompressor = decompressedHeader.newDecoder();
+		ImageMarlinDecoder* decompressor = decompressedHeader.newDecoder(decodeThreads);
 		std::vector<uint8_t> decompressedData(decompressedHeader.rows * decompressedHeader.cols);
 
 		Profiler::start("decompression");